@@ -0,0 +1,8 @@
+#version 330 core
+
+out vec4 color;
+
+// Color writes are masked off, only the depth test result is counted
+void main() {
+    color = vec4(1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+layout(location = 0) in vec3 vertexPosition_modelspace;
+
+// Unit cube stretched over a bounding box
+uniform mat4 VP;
+uniform vec3 boxCenter;
+uniform vec3 boxExtent;
+
+void main() {
+    gl_Position = VP * vec4(boxCenter + vertexPosition_modelspace * boxExtent, 1.0);
+}
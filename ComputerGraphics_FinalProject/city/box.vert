@@ -6,8 +6,9 @@ layout(location = 1) in vec2 vertexUV;
 out vec2 UV;
 
 uniform mat4 MVP;
+uniform vec2 uvScale;
 
 void main() {
     gl_Position = MVP * vec4(vertexPosition_modelspace, 1.0);
-    UV = vertexUV;
+    UV = vertexUV * uvScale;
 }
@@ -0,0 +1,21 @@
+#version 330 core
+
+// Shared unit cube
+layout(location = 0) in vec3 vertexPosition_modelspace;
+layout(location = 1) in vec2 vertexUV;
+
+// Per-building instance data
+layout(location = 2) in vec3 instanceTranslation;
+layout(location = 3) in vec3 instanceScale;
+layout(location = 4) in vec2 instanceUVScale;
+
+out vec2 UV;
+
+// View-projection matrix, the model transform comes from the instance data
+uniform mat4 VP;
+
+void main() {
+    vec3 worldPosition = instanceTranslation + vertexPosition_modelspace * instanceScale;
+    gl_Position = VP * vec4(worldPosition, 1.0);
+    UV = vertexUV * instanceUVScale;
+}
@@ -4,13 +4,22 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <render/shader.h>
+#include <render/texture.h>
+#include <render/culling.h>
+#include <render/occlusion.h>
+#include <render/mesh.h>
+#include <render/state.h>
+#include <world/city_generator.h>
 #include <glm/gtc/type_ptr.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-
 #include <vector>
 #include <iostream>
+#include <cstddef>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <cstdlib>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <glm/glm.hpp>
@@ -32,183 +41,190 @@ float deltaTime = 0.0f;
 static float Azimuth = 0.f;
 static float Polar = 0.f;
 static float Distance = 600.0f;
+// How buildings are submitted: one draw each, one instanced draw, or one merged draw per chunk
+enum RenderMode {
+    RENDER_PER_BUILDING,
+    RENDER_INSTANCED,
+    RENDER_BATCHED
+};
+static const char *renderModeNames[] = { "Per-building", "Instanced", "Batched" };
+static RenderMode renderMode = RENDER_INSTANCED;
+static bool benchmarkRequested = false;
+static bool useOcclusionCulling = false;
+
+
+// Unit cube shared by the buildings, the instancer and the merged batches
+static const GLfloat cube_vertex_data[72] = {
+    -1.0f, -1.0f, 1.0f,
+    1.0f, -1.0f, 1.0f,
+    1.0f, 1.0f, 1.0f,
+    -1.0f, 1.0f, 1.0f,
+
+    1.0f, -1.0f, -1.0f,
+    -1.0f, -1.0f, -1.0f,
+    -1.0f, 1.0f, -1.0f,
+    1.0f, 1.0f, -1.0f,
+
+    -1.0f, -1.0f, -1.0f,
+    -1.0f, -1.0f, 1.0f,
+    -1.0f, 1.0f, 1.0f,
+    -1.0f, 1.0f, -1.0f,
+
+    1.0f, -1.0f, 1.0f,
+    1.0f, -1.0f, -1.0f,
+    1.0f, 1.0f, -1.0f,
+    1.0f, 1.0f, 1.0f,
+
+    -1.0f, 1.0f, 1.0f,
+    1.0f, 1.0f, 1.0f,
+    1.0f, 1.0f, -1.0f,
+    -1.0f, 1.0f, -1.0f,
+
+    -1.0f, -1.0f, -1.0f,
+    1.0f, -1.0f, -1.0f,
+    1.0f, -1.0f, 1.0f,
+    -1.0f, -1.0f, 1.0f,
+};
 
+// Index data for drawing the building faces from outside
+static const GLuint building_index_data[36] = {
+    0, 1, 2,
+    0, 2, 3,
 
-// Function to load a texture from a file and set it up for OpenGL
-static GLuint LoadTextureTileBox(const char *texture_file_path) {
-    int w, h, channels; // Variables to store texture width, height, and number of channels
-    stbi_set_flip_vertically_on_load(false); // Ensure the image is loaded without flipping vertically (default behavior)
-
-    // Load the image file into memory
-    uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3); // Load image with 3 color channels (RGB)
-    
-    GLuint texture; // Variable to hold the generated texture ID
-    glGenTextures(1, &texture); // Generate an OpenGL texture object
-    glBindTexture(GL_TEXTURE_2D, texture); // Bind the texture as a 2D texture
-
-    // Set texture wrapping parameters for the S and T axes (horizontal and vertical)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // Repeat texture horizontally
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // Repeat texture vertically
-
-    // Set filtering options for minification and magnification
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // Use mipmaps and linear filtering for minification
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Use linear filtering for magnification
-
-    // Check if the image was successfully loaded
-    if (img) {
-        // Specify a 2D texture image, with width, height, and pixel data from the loaded image
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
+    4, 5, 6,
+    4, 6, 7,
 
-        // Generate mipmaps for the texture to improve rendering at different distances
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        // Log an error message if the image failed to load
-        std::cout << "Failed to load texture " << texture_file_path << std::endl;
-    }
+    8, 9, 10,
+    8, 10, 11,
 
-    // Free the memory used by the loaded image since it's no longer needed
-    stbi_image_free(img);
+    12, 13, 14,
+    12, 14, 15,
 
-    // Return the OpenGL texture ID
-    return texture;
-}
+    16, 17, 18,
+    16, 18, 19,
 
-// Struct to represent a Skybox in the scene
-struct Skybox {
-    // Position and scale of the skybox
-    glm::vec3 pos;
-    glm::vec3 scale;
-
-    // Vertex positions for the cube representing the skybox
-    GLfloat vertex_buffer_data[72] = {
-
-        -1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-
-        1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, -1.0f,
-
-        1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-
-        -1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-    };
-
-    // Color data for each vertex of the skybox
-    GLfloat color_buffer_data[72] = {
-
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-
-        1.0f, 1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,
-
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-
-        0.0f, 1.0f, 1.0f,
-        0.0f, 1.0f, 1.0f,
-        0.0f, 1.0f, 1.0f,
-        0.0f, 1.0f, 1.0f,
-
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-
-        1.0f, 0.0f, 1.0f,
-        1.0f, 0.0f, 1.0f,
-        1.0f, 0.0f, 1.0f,
-        1.0f, 0.0f, 1.0f,
-    };
-
-    // Index buffer to define triangles for rendering the cube
-    GLuint index_buffer_data[36] = {
-        0, 3, 2,
-        0, 2, 1,
+    20, 21, 22,
+    20, 22, 23,
+};
 
-        4, 7, 6,
-        4, 6, 5,
+// Building UVs before scaling to the building size (the roof and floor are left blank)
+static const GLfloat building_uv_data[48] = {
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 0.0f,
+
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 0.0f,
+
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 0.0f,
+
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 0.0f,
+
+    0.0f, 0.0f,
+    0.0f, 0.0f,
+    0.0f, 0.0f,
+    0.0f, 0.0f,
+
+    0.0f, 0.0f,
+    0.0f, 0.0f,
+    0.0f, 0.0f,
+    0.0f, 0.0f,
+};
 
-        8, 11, 10,
-        8, 10, 9,
+// Index buffer to define the skybox triangles, wound to face inwards
+static const GLuint skybox_index_data[36] = {
+    0, 3, 2,
+    0, 2, 1,
 
-        12, 15, 14,
-        12, 14, 13,
+    4, 7, 6,
+    4, 6, 5,
 
-        16, 19, 18,
-        16, 18, 17,
+    8, 11, 10,
+    8, 10, 9,
 
-        20, 23, 22,
-        20, 22, 21,
-    };
+    12, 15, 14,
+    12, 14, 13,
 
-    // UV coordinates for texture mapping
-    GLfloat uv_buffer_data[48] = {
+    16, 19, 18,
+    16, 18, 17,
 
-        0.5f, 0.666f,
-        0.25f, 0.666f,
-        0.25f, 0.333f,
-        0.5f, 0.333f,
+    20, 23, 22,
+    20, 22, 21,
+};
 
-        1.0f, 0.666f,
-        0.75f, 0.666f,
-        0.75f, 0.333f,
-        1.0f, 0.333f,
+// UV coordinates mapping each face of the skybox to the cross-shaped sky texture
+static const GLfloat skybox_uv_data[48] = {
+    0.5f, 0.666f,
+    0.25f, 0.666f,
+    0.25f, 0.333f,
+    0.5f, 0.333f,
+
+    1.0f, 0.666f,
+    0.75f, 0.666f,
+    0.75f, 0.333f,
+    1.0f, 0.333f,
+
+    0.75f, 0.666f,
+    0.5f, 0.666f,
+    0.5f, 0.333f,
+    0.75f, 0.333f,
+
+    0.25f, 0.666f,
+    0.0f, 0.666f,
+    0.0f, 0.333f,
+    0.25f, 0.333f,
+
+    0.5f, 0.333f,
+    0.25f, 0.333f,
+    0.25f, 0.0f,
+    0.5f, 0.0f,
+
+    0.5f, 1.0f,
+    0.25f, 1.0f,
+    0.25f, 0.666f,
+    0.5f, 0.666f,
+};
 
-        0.75f, 0.666f,
-        0.5f, 0.666f,
-        0.5f, 0.333f,
-        0.75f, 0.333f,
+// Gather the cube positions with the given UVs and indices
+static MeshData BuildCubeMeshData(const GLfloat *uvs, const GLuint *indices) {
+    MeshData data;
+    data.primitive = GL_TRIANGLES;
+    for (int i = 0; i < 24; ++i) {
+        data.positions.push_back(glm::vec3(cube_vertex_data[3 * i + 0], cube_vertex_data[3 * i + 1], cube_vertex_data[3 * i + 2]));
+        data.uvs.push_back(glm::vec2(uvs[2 * i + 0], uvs[2 * i + 1]));
+    }
+    data.indices.assign(indices, indices + 36);
+    return data;
+}
 
-        0.25f, 0.666f,
-        0.0f, 0.666f,
-        0.0f, 0.333f,
-        0.25f, 0.333f,
+static MeshData BuildBuildingMesh() {
+    return BuildCubeMeshData(building_uv_data, building_index_data);
+}
 
-        0.5f, 0.333f,
-        0.25f, 0.333f,
-        0.25f, 0.0f,
-        0.5f, 0.0f,
+static MeshData BuildSkyboxMesh() {
+    return BuildCubeMeshData(skybox_uv_data, skybox_index_data);
+}
 
-        0.5f, 1.0f,
-        0.25f, 1.0f,
-        0.25f, 0.666f,
-        0.5f, 0.666f,
+// Unit cube positions and UVs both fit normalized shorts: 12 bytes per vertex instead of 20
+static const MeshFormat cubeMeshFormat = { MESH_SNORM16, MESH_UNORM16 };
 
-    };
+// Struct to represent a Skybox in the scene
+struct Skybox {
+    // Position and scale of the skybox
+    glm::vec3 pos;
+    glm::vec3 scale;
 
-    // OpenGL buffers
-    GLuint vertexArrayID;
-    GLuint vertexBufferID;
-    GLuint indexBufferID;
-    GLuint colorBufferID;
-    GLuint uvBufferID;
+    // Shared cube mesh and texture
+    Mesh mesh;
     GLuint textureID;
 
     // Shader variable IDs
@@ -221,99 +237,47 @@ struct Skybox {
 
         this->pos = pos;
         this->scale = scale;
-        
-        // Generate and bind the Vertex Array Object (VAO)
-        glGenVertexArrays(1, &vertexArrayID);
-        glBindVertexArray(vertexArrayID);
-        
-        // Generate and upload vertex data
-        glGenBuffers(1, &vertexBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-        // Generate and upload color data
-        glGenBuffers(1, &colorBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
-
-        // Generate and upload UV data
-        glGenBuffers(1, &uvBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
-
-        // Generate and upload index data
-        glGenBuffers(1, &indexBufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+
+        // Upload the cube with the sky UVs
+        mesh = AcquireMesh("skybox", BuildSkyboxMesh, cubeMeshFormat);
 
         // Load shaders
-        programID = LoadShadersFromFile("../city/skybox.vert", "../city/skybox.frag");
+        programID = AcquireShaderProgram("../city/skybox.vert", "../city/skybox.frag");
         if (programID == 0)
         {
             std::cerr << "Failed to load shaders." << std::endl;
         }
 
         // Load texture
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-        textureID = LoadTextureTileBox("../city/sky.png");
-        textureSamplerID =glGetUniformLocation(programID, "textureSampler");
+        mvpMatrixID = GetCachedUniformLocation(programID, "MVP");
+        textureID = AcquireTexture("../city/sky.png");
+        textureSamplerID =GetCachedUniformLocation(programID, "textureSampler");
     }
 
     // Function to render the skybox
     void render(glm::mat4 cameraMatrix) {
-        glUseProgram(programID);
-        
-        // Bind and configure vertex attributes
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        // Bind index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+        UseProgramCached(programID);
 
         // Create model matrix and calculate MVP
         glm::mat4 modelMatrix = glm::mat4();
+        modelMatrix = glm::translate(modelMatrix, pos);
         modelMatrix = glm::scale(modelMatrix, scale);
         glm::mat4 mvp = cameraMatrix * modelMatrix;
         glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
 
         // Bind texture
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glUniform1i(textureSamplerID, 0);
-
-
+        BindTextureCached(0, textureID);
+        SetUniform1iCached(programID, textureSamplerID, 0);
 
         // Draw the box
-        glDrawElements(
-            GL_TRIANGLES,
-            36,
-            GL_UNSIGNED_INT,
-            (void*)0
-        );
-
-        // Disable vertex attributes
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        DrawMesh(mesh);
     }
 
     // Function to clean up allocated resources
     void cleanup() {
-        glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &colorBufferID);
-        glDeleteBuffers(1, &indexBufferID);
-        glDeleteVertexArrays(1, &vertexArrayID);
-        glDeleteBuffers(1, &uvBufferID);
-        glDeleteTextures(1, &textureID);
-        glDeleteProgram(programID);
+        ReleaseMesh(mesh);
+        ReleaseTexture(textureID);
+        ReleaseShaderProgram(programID);
     }
 
 };
@@ -324,136 +288,13 @@ struct Building {
     glm::vec3 pos;
     glm::vec3 scale;
 
-    // Vertex data for the building (a cube shape)
-    GLfloat vertex_buffer_data[72] = {
-        -1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-
-        1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, -1.0f,
-
-        1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-
-        -1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-    };
-
-    // Color data for each vertex of the skybox
-    GLfloat color_buffer_data[72] = {
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-
-        1.0f, 1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,
-        1.0f, 1.0f, 0.0f,
-
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-
-        0.0f, 1.0f, 1.0f,
-        0.0f, 1.0f, 1.0f,
-        0.0f, 1.0f, 1.0f,
-        0.0f, 1.0f, 1.0f,
-
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-
-        1.0f, 0.0f, 1.0f,
-        1.0f, 0.0f, 1.0f,
-        1.0f, 0.0f, 1.0f,
-        1.0f, 0.0f, 1.0f,
-    };
-
-    // Index data for drawing triangles (faces of the cube)
-    GLuint index_buffer_data[36] = {
-        0, 1, 2,
-        0, 2, 3,
-
-        4, 5, 6,
-        4, 6, 7,
-
-        8, 9, 10,
-        8, 10, 11,
-
-        12, 13, 14,
-        12, 14, 15,
-
-        16, 17, 18,
-        16, 18, 19,
-
-        20, 21, 22,
-        20, 22, 23,
-    };
-
-    // UV mapping for texture coordinates
-    GLfloat uv_buffer_data[48] = {
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-    };
-
-    // OpenGL buffer IDs
-    GLuint vertexArrayID;
-    GLuint vertexBufferID;
-    GLuint indexBufferID;
-    GLuint colorBufferID;
-    GLuint uvBufferID;
+    // Shared cube mesh and texture
+    Mesh mesh;
     GLuint textureID;
 
     // Shader and uniform variable IDs
     GLuint mvpMatrixID;
+    GLuint uvScaleID;
     GLuint textureSamplerID;
     GLuint programID;
 
@@ -462,50 +303,40 @@ struct Building {
         this->pos = pos;
         this->scale = scale;
 
-        // Scale the UV mapping to adapt to the building's size
-        for (int i = 0; i < 24; ++i) {
-            uv_buffer_data[2 * i + 0] *= scale.x / 50.0f; // Scale U based on building width
-            uv_buffer_data[2 * i + 1] *= scale.y / 50.0f; // Scale V based on building height
-        }
-
-        // Generate and bind the Vertex Array Object
-        glGenVertexArrays(1, &vertexArrayID);
-        glBindVertexArray(vertexArrayID);
-
-        // Generate and upload vertex data
-        glGenBuffers(1, &vertexBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-        // Generate and upload UV mapping data
-        glGenBuffers(1, &uvBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
-
-        // Generate and upload index data
-        glGenBuffers(1, &indexBufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+        // Every building draws the same unit cube
+        mesh = AcquireMesh("building", BuildBuildingMesh, cubeMeshFormat);
 
         // Load shaders for rendering the building
-        programID = LoadShadersFromFile("../city/box.vert", "../city/box.frag");
+        programID = AcquireShaderProgram("../city/box.vert", "../city/box.frag");
         // Get uniform variable IDs
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-        textureSamplerID = glGetUniformLocation(programID, "textureSampler");
+        mvpMatrixID = GetCachedUniformLocation(programID, "MVP");
+        uvScaleID = GetCachedUniformLocation(programID, "uvScale");
+        textureSamplerID = GetCachedUniformLocation(programID, "textureSampler");
         // Load texture for the building
-        textureID = LoadTextureTileBox(texturePath);
+        textureID = AcquireTexture(texturePath);
+    }
+
+    // Scale of the UV mapping to adapt to the building's size
+    glm::vec2 getUVScale() const {
+        return glm::vec2(scale.x / 50.0f, scale.y / 50.0f); // U based on building width, V on height
+    }
+
+    // World-space bounds of the scaled unit cube
+    AABB getBounds() const {
+        AABB bounds;
+        bounds.min = pos - scale;
+        bounds.max = pos + scale;
+        return bounds;
+    }
+
+    // State-sorting key for the draw list
+    DrawSortKey getSortKey() const {
+        return MakeDrawSortKey(programID, textureID, mesh.vertexArrayID);
     }
 
     // Render the building
     void render(glm::mat4 cameraMatrix) {
-      glUseProgram(programID);
-      // Bind and configure vertex attributes
-      glEnableVertexAttribArray(0);
-      glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-      // Bind index buffer for drawing
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+      UseProgramCached(programID);
 
       // Create model matrix for position and scale
       glm::mat4 modelMatrix = glm::mat4(1.0f);
@@ -515,49 +346,253 @@ struct Building {
       // Calculate and send the MVP matrix to the shader
       glm::mat4 mvp = cameraMatrix * modelMatrix;
       glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-
-      // Bind and configure UV data
-      glEnableVertexAttribArray(1);
-      glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+      glm::vec2 uvScale = getUVScale();
+      SetUniform2fCached(programID, uvScaleID, uvScale.x, uvScale.y);
 
       // Bind texture
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, textureID);
-      glUniform1i(textureSamplerID, 0);
+      BindTextureCached(0, textureID);
+      SetUniform1iCached(programID, textureSamplerID, 0);
 
       // Draw the building as a set of triangles
-      glDrawElements(
-          GL_TRIANGLES,
-          36,
-          GL_UNSIGNED_INT,
-          (void*)0
-      );
+      DrawMesh(mesh);
+    }
+
+    // Cleanup allocated resources
+    void cleanup() {
+        ReleaseMesh(mesh);
+        ReleaseTexture(textureID);
+        ReleaseShaderProgram(programID);
+    }
+};
+
+// Struct to draw every building with one instanced draw call
+struct BuildingInstancer {
+    // Per-building data stored in the instance buffer
+    struct Instance {
+        glm::vec3 translation;
+        glm::vec3 scale;
+        glm::vec2 uvScale;
+    };
+    std::vector<Instance> instances;
+    std::vector<Instance> visibleInstances;
+
+    // Shared cube mesh, plus a VAO combining it with the instance buffer
+    Mesh mesh;
+    GLuint vertexArrayID;
+    GLuint instanceBufferID;
+    GLuint textureID;
 
-      // Disable vertex attributes
-      glDisableVertexAttribArray(0);
-      glDisableVertexAttribArray(1);
+    // Shader and uniform variable IDs
+    GLuint vpMatrixID;
+    GLuint textureSamplerID;
+    GLuint programID;
+
+    // Initialize the shared unit cube and the (empty) instance buffer
+    void initialize(const char* texturePath="../city/building_texture.jpg") {
+        // The same unit cube the buildings use, with unscaled UVs
+        mesh = AcquireMesh("building", BuildBuildingMesh, cubeMeshFormat);
+
+        // Generate and bind the Vertex Array Object, reading the cube mesh buffers
+        glGenVertexArrays(1, &vertexArrayID);
+        glBindVertexArray(vertexArrayID);
+        AttachMesh(mesh);
+
+        // Generate the instance buffer, one Instance per building, advanced once per instance
+        glGenBuffers(1, &instanceBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, translation));
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, scale));
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, uvScale));
+        glVertexAttribDivisor(4, 1);
+
+        glBindVertexArray(0);
+
+        // Load the instanced variant of the box shader
+        programID = AcquireShaderProgram("../city/box_instanced.vert", "../city/box.frag");
+        vpMatrixID = GetCachedUniformLocation(programID, "VP");
+        textureSamplerID = GetCachedUniformLocation(programID, "textureSampler");
+        textureID = AcquireTexture(texturePath);
+    }
+
+    // Add a building to the instance buffer
+    void add(const Building &building) {
+        Instance instance;
+        instance.translation = building.pos;
+        instance.scale = building.scale;
+        instance.uvScale = building.getUVScale();
+        instances.push_back(instance);
+    }
 
+    // Remove all buildings from the instance buffer
+    void clear() {
+        instances.clear();
+    }
+
+    // Render the visible buildings (indices in add() order) with a single draw call
+    void render(glm::mat4 cameraMatrix, const std::vector<int> &visible) {
+        if (visible.empty()) {
+            return;
+        }
+
+        // Gather this frame's visible instances
+        visibleInstances.clear();
+        for (int index : visible) {
+            visibleInstances.push_back(instances[index]);
+        }
+
+        UseProgramCached(programID);
+        BindVertexArrayCached(vertexArrayID);
+
+        // Orphan the instance buffer so the driver need not wait for last frame's draw
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, visibleInstances.size() * sizeof(Instance), visibleInstances.data());
+
+        glUniformMatrix4fv(vpMatrixID, 1, GL_FALSE, &cameraMatrix[0][0]);
+
+        // Bind texture
+        BindTextureCached(0, textureID);
+        SetUniform1iCached(programID, textureSamplerID, 0);
+
+        // Draw every building at once
+        glDrawElementsInstanced(
+            mesh.primitive,
+            mesh.count,
+            mesh.indexType,
+            (void*)0,
+            (GLsizei)visibleInstances.size()
+        );
     }
 
     // Cleanup allocated resources
     void cleanup() {
-        glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &colorBufferID);
-        glDeleteBuffers(1, &indexBufferID);
+        glDeleteBuffers(1, &instanceBufferID);
         glDeleteVertexArrays(1, &vertexArrayID);
-        glDeleteBuffers(1, &uvBufferID);
-        glDeleteTextures(1, &textureID);
-        glDeleteProgram(programID);
+        ReleaseMesh(mesh);
+        ReleaseTexture(textureID);
+        ReleaseShaderProgram(programID);
+    }
+};
+
+// Struct to draw a group of static buildings (one city chunk) from a single merged buffer
+struct BuildingBatch {
+    // World-space bounds of every building in the batch
+    AABB bounds;
+    int buildingCount;
+
+    // Merged mesh: float world positions, half-float UVs pre-scaled per building
+    Mesh mesh;
+    GLuint textureID;
+
+    // Shader and uniform variable IDs
+    GLuint mvpMatrixID;
+    GLuint uvScaleID;
+    GLuint textureSamplerID;
+    GLuint programID;
+
+    // Bake the buildings into one vertex and index buffer
+    void initialize(const std::vector<Building> &buildings, const char* texturePath="../city/building_texture.jpg") {
+        MeshData data;
+        data.primitive = GL_TRIANGLES;
+        data.positions.reserve(buildings.size() * 24);
+        data.uvs.reserve(buildings.size() * 24);
+        data.indices.reserve(buildings.size() * 36);
+
+        bounds.min = glm::vec3(0.0f);
+        bounds.max = glm::vec3(0.0f);
+        for (size_t b = 0; b < buildings.size(); ++b) {
+            const Building &building = buildings[b];
+            GLuint firstVertex = (GLuint)data.positions.size();
+
+            // Pre-transform the cube and apply the per-building UV scale
+            glm::vec2 uvScale = building.getUVScale();
+            for (int i = 0; i < 24; ++i) {
+                data.positions.push_back(building.pos + building.scale * glm::vec3(cube_vertex_data[3 * i + 0],
+                                                                                   cube_vertex_data[3 * i + 1],
+                                                                                   cube_vertex_data[3 * i + 2]));
+                data.uvs.push_back(uvScale * glm::vec2(building_uv_data[2 * i + 0], building_uv_data[2 * i + 1]));
+            }
+            for (int i = 0; i < 36; ++i) {
+                data.indices.push_back(firstVertex + building_index_data[i]);
+            }
+
+            AABB buildingBounds = building.getBounds();
+            bounds.min = b == 0 ? buildingBounds.min : glm::min(bounds.min, buildingBounds.min);
+            bounds.max = b == 0 ? buildingBounds.max : glm::max(bounds.max, buildingBounds.max);
+        }
+        buildingCount = (int)buildings.size();
+
+        // Positions span the whole chunk and need full floats
+        MeshFormat format = { MESH_FLOAT, MESH_HALF };
+        mesh = CreateMesh(data, format);
+
+        // Positions are already in world space, so the box shader only needs the camera matrix
+        programID = AcquireShaderProgram("../city/box.vert", "../city/box.frag");
+        mvpMatrixID = GetCachedUniformLocation(programID, "MVP");
+        uvScaleID = GetCachedUniformLocation(programID, "uvScale");
+        textureSamplerID = GetCachedUniformLocation(programID, "textureSampler");
+        textureID = AcquireTexture(texturePath);
+    }
+
+    // State-sorting key for the draw list
+    DrawSortKey getSortKey() const {
+        return MakeDrawSortKey(programID, textureID, mesh.vertexArrayID);
+    }
+
+    // Render every building in the batch with a single draw call
+    void render(glm::mat4 cameraMatrix) {
+        if (mesh.count == 0) {
+            return;
+        }
+
+        UseProgramCached(programID);
+        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &cameraMatrix[0][0]);
+        SetUniform2fCached(programID, uvScaleID, 1.0f, 1.0f);
+
+        // Bind texture
+        BindTextureCached(0, textureID);
+        SetUniform1iCached(programID, textureSamplerID, 0);
+
+        DrawMesh(mesh);
+    }
+
+    // Cleanup allocated resources
+    void cleanup() {
+        DestroyMesh(mesh);
+        ReleaseTexture(textureID);
+        ReleaseShaderProgram(programID);
     }
 };
 
+// Large rectangle for the road, drawn as a triangle fan
+static MeshData BuildRoadMesh() {
+    MeshData data;
+    data.primitive = GL_TRIANGLE_FAN;
+    data.positions.push_back(glm::vec3(-1000.0f, -40.0f, -1000.0f));
+    data.positions.push_back(glm::vec3(-1000.0f, -40.0f, 1000.0f));
+    data.positions.push_back(glm::vec3(1000.0f, -40.0f, 1000.0f));
+    data.positions.push_back(glm::vec3(1000.0f, -40.0f, -1000.0f));
+
+    // UV texture coordinates for the road, repeating the texture 100 times
+    data.uvs.push_back(glm::vec2(0.0f, 0.0f));
+    data.uvs.push_back(glm::vec2(0.0f, 100.0f));
+    data.uvs.push_back(glm::vec2(100.0f, 100.0f));
+    data.uvs.push_back(glm::vec2(100.0f, 0.0f));
+    return data;
+}
+
 // Struct to represent a road in the scene
 struct Road {
-    // OpenGL buffer and shader program IDs
-    GLuint vertexArrayID;
-    GLuint vertexBufferID;
-    GLuint uvBufferID;
+    // Offset of the road plane, moved along with the camera
+    glm::vec3 pos = glm::vec3(0.0f);
+
+    // Road mesh, texture and shader program IDs
+    Mesh mesh;
     GLuint textureID;
     GLuint programID;
     GLuint mvpMatrixID;
@@ -565,93 +600,50 @@ struct Road {
 
     // Initialize the road
     void initialize() {
-        // Vertex data representing a large rectangle for the road
-        GLfloat vertex_buffer_data[] = {
-            -1000.0f, -40.0f, -1000.0f,
-            -1000.0f, -40.0f, 1000.0f,
-            1000.0f, -40.0f, 1000.0f,
-            1000.0f, -40.0f, -1000.0f
-        };
-
-        // UV texture coordinates for the road
-        GLfloat uv_buffer_data[] = {
-            0.0f, 0.0f,
-            0.0f, 100.0f,
-            100.0f, 100.0f,
-            100.0f, 0.0f
-        };
-
-        // Generate and bind the Vertex Array Object
-        glGenVertexArrays(1, &vertexArrayID);
-        glBindVertexArray(vertexArrayID);
-
-        // Generate and upload vertex data to the GPU
-        glGenBuffers(1, &vertexBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-        // Generate and upload UV mapping data to the GPU
-        glGenBuffers(1, &uvBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
+        // Every road coordinate is a whole number below 2048, exact in half floats
+        MeshFormat format = { MESH_HALF, MESH_HALF };
+        mesh = AcquireMesh("road", BuildRoadMesh, format);
 
         // Load and compile the shaders for the road
-        programID = LoadShadersFromFile("../city/road.vert", "../city/road.frag");
+        programID = AcquireShaderProgram("../city/road.vert", "../city/road.frag");
         
         // Get the uniform variable locations in the shader program
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-        textureSamplerID = glGetUniformLocation(programID, "textureSampler");
+        mvpMatrixID = GetCachedUniformLocation(programID, "MVP");
+        textureSamplerID = GetCachedUniformLocation(programID, "textureSampler");
         
         // Load the texture for the road surface
-        textureID = LoadTextureTileBox("../city/road_texture.jpg");
+        textureID = AcquireTexture("../city/road_texture.jpg");
     }
 
     // Render the road
     void render(glm::mat4 cameraMatrix) {
         // Use the shader program
-        glUseProgram(programID);
+        UseProgramCached(programID);
 
-        // Bind and configure the vertex data
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        // Bind and configure the UV data
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-        // Create the Model matrix (identity, as the road is static)
-        glm::mat4 modelMatrix = glm::mat4(1.0f);
+        // Create the Model matrix from the road offset
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), pos);
         
         // Calculate and send the MVP matrix to the shader
         glm::mat4 mvp = cameraMatrix * modelMatrix;
         glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
 
         // Bind the road texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glUniform1i(textureSamplerID, 0);
+        BindTextureCached(0, textureID);
+        SetUniform1iCached(programID, textureSamplerID, 0);
 
         // Draw the road as a triangle fan (connecting all vertices)
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-        // Disable the vertex attributes after drawing
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
+        DrawMesh(mesh);
     }
 
     // Cleanup resources to prevent memory leaks
     void cleanup() {
-        glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &uvBufferID);
-        glDeleteVertexArrays(1, &vertexArrayID);
-        glDeleteTextures(1, &textureID);
-        glDeleteProgram(programID);
+        ReleaseMesh(mesh);
+        ReleaseTexture(textureID);
+        ReleaseShaderProgram(programID);
     }
 };
 
-int main(void) {
+int main(int argc, char **argv) {
     // Initialize GLFW for window and OpenGL context management
     if (!glfwInit())
     {
@@ -694,10 +686,12 @@ int main(void) {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    // Define containers for buildings
+    // Define container for buildings
     std::vector<Building> buildings;
-    std::vector<Building> buildings2;
-    std::vector<Building> buildings3;
+
+    // Shared cube and instance buffer drawing the whole city at once
+    BuildingInstancer buildingInstancer;
+    buildingInstancer.initialize();
 
     // Initialize the skybox with position and scale
     Skybox skybox;
@@ -707,29 +701,53 @@ int main(void) {
     Road road;
     road.initialize();
     
-    // Procedurally generate buildings in a grid layout
-    for (int row = 0; row < 10; ++row) {
-        for (int col = 0; col < 10; ++col) {
-            Building b;
-            // Randomly calculate building positions and dimensions
-            float spacing = 200.0f;
-            float randomOffsetX = static_cast<float>(rand()) / RAND_MAX * 50.0f;
-            float randomOffsetZ = static_cast<float>(rand()) / RAND_MAX * 50.0f;
-            float xPos = -800.0f + (col * spacing) + randomOffsetX;
-            float zPos = -800.0f + (row * spacing) + randomOffsetZ;
-            float height = 100.0f + static_cast<float>(rand()) / RAND_MAX * 200.0f;
-            float buildingWidth = 30.0f + static_cast<float>(rand()) / RAND_MAX * 20.0f;
-            float buildingDepth = 30.0f + static_cast<float>(rand()) / RAND_MAX * 20.0f;
-
-            // Set the position and scale of the building
-            glm::vec3 pos(xPos, height / 2, zPos);
-            glm::vec3 scale(buildingWidth, height, buildingDepth);
-
-            // Initialize and store the building
-            b.initialize(pos, scale);
-            buildings3.push_back(b);
-        }
-    }
+    // Stream the city in chunks around the camera; the same seed always builds the same city
+    unsigned int citySeed = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 1234u;
+    std::cout << "City seed: " << citySeed << std::endl;
+    CityGenerator cityGenerator;
+    unsigned int generatorThreads = std::thread::hardware_concurrency();
+    cityGenerator.initialize(citySeed, generatorThreads > 1 ? (int)generatorThreads - 1 : 1);
+    std::map<ChunkCoord, std::vector<Building> > chunkBuildings;
+
+    // One merged batch per chunk, culled at chunk granularity
+    std::map<ChunkCoord, BuildingBatch> chunkBatches;
+    std::vector<BuildingBatch*> batches;
+    std::vector<AABB> batchBounds;
+    BoundingVolumeHierarchy batchBVH;
+    std::vector<int> visibleBatches;
+
+    // Bounding volume hierarchy over the buildings for frustum culling
+    std::vector<AABB> buildingBounds;
+    BoundingVolumeHierarchy buildingBVH;
+    std::vector<int> visibleBuildings;
+    double lastStatsTime = glfwGetTime();
+
+    // Occlusion queries on the building bounds, one per building
+    OcclusionCuller occlusionCuller;
+    occlusionCuller.initialize(0);
+    std::vector<int> frustumVisibleBuildings;
+
+    // Draws of the current frame paired with their state sort keys
+    std::vector<std::pair<DrawSortKey, int> > drawOrder;
+
+    // Benchmark: draw the same view in every render mode and compare the CPU cost of submitting the buildings
+    const RenderMode benchmarkModes[3] = { RENDER_PER_BUILDING, RENDER_INSTANCED, RENDER_BATCHED };
+    const int benchmarkWarmupFrames = 20;
+    const int benchmarkFrames = 300;
+    int benchmarkStage = -1;
+    int benchmarkFrame = 0;
+    double benchmarkSubmitTime = 0.0;
+    double benchmarkFrameTime = 0.0;
+    long benchmarkDrawCalls = 0;
+    RenderMode benchmarkRestoreMode = renderMode;
+    bool benchmarkRestoreOcclusion = useOcclusionCulling;
+
+    // Report how many shader compiles the shared registry saved
+    ShaderRegistryStats shaderStats = GetShaderRegistryStats();
+    std::cout << "Shader registry: " << shaderStats.programsCompiled << " programs compiled, "
+              << shaderStats.compilesAvoided << " compiles avoided" << std::endl;
+
+
     // Set the initial camera position using spherical coordinates
     eye.y = Distance * cos(Polar);
     eye.x = Distance * cos(Azimuth);
@@ -744,10 +762,93 @@ int main(void) {
 
     // Main render loop
     do {
-        float currentFrame = glfwGetTime();
+        double frameStart = glfwGetTime();
+        float currentFrame = frameStart;
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // Upload textures decoded in the background, at most 2 ms per frame
+        if (PumpTextureUploads(0.002) > 0 && GetTextureCacheStats().pendingUploads == 0) {
+            // Report how many texture decodes the cache saved once everything is resident
+            TextureCacheStats textureStats = GetTextureCacheStats();
+            std::cout << "Texture cache: " << textureStats.misses << " misses, " << textureStats.hits << " hits, "
+                      << textureStats.residentBytes / 1024 << " KB resident" << std::endl;
+        }
+
+        // Request chunks around the camera and pick up the ones generated in the background
+        std::vector<ChunkCoord> evictedChunks;
+        std::vector<CityChunk> readyChunks;
+        cityGenerator.update(eye, evictedChunks);
+        cityGenerator.takeFinishedChunks(readyChunks);
+        if (!evictedChunks.empty() || !readyChunks.empty()) {
+            for (const ChunkCoord &coord : evictedChunks) {
+                for (auto &building : chunkBuildings[coord]) {
+                    building.cleanup();
+                }
+                chunkBuildings.erase(coord);
+                chunkBatches[coord].cleanup();
+                chunkBatches.erase(coord);
+            }
+            for (const CityChunk &chunk : readyChunks) {
+                std::vector<Building> &loadedBuildings = chunkBuildings[chunk.coord];
+                for (const BuildingDesc &desc : chunk.buildings) {
+                    Building b;
+                    b.initialize(desc.pos, desc.scale);
+                    loadedBuildings.push_back(b);
+                }
+                chunkBatches[chunk.coord].initialize(loadedBuildings);
+            }
+
+            // Rebuild the flat building list, instance buffer and culling structures
+            buildings.clear();
+            buildingInstancer.clear();
+            buildingBounds.clear();
+            for (auto &entry : chunkBuildings) {
+                for (auto &building : entry.second) {
+                    buildings.push_back(building);
+                    buildingInstancer.add(building);
+                    buildingBounds.push_back(building.getBounds());
+                }
+            }
+            buildingBVH.build(buildingBounds);
+            occlusionCuller.resize((int)buildings.size());
+
+            batches.clear();
+            batchBounds.clear();
+            for (auto &entry : chunkBatches) {
+                if (entry.second.buildingCount > 0) {
+                    batches.push_back(&entry.second);
+                    batchBounds.push_back(entry.second.bounds);
+                }
+            }
+            batchBVH.build(batchBounds);
+        }
+
+        // Run each render mode in turn while benchmarking, without occlusion culling so they draw the same set
+        if (benchmarkRequested && benchmarkStage < 0) {
+            benchmarkRequested = false;
+            benchmarkStage = 0;
+            benchmarkFrame = 0;
+            benchmarkSubmitTime = benchmarkFrameTime = 0.0;
+            benchmarkDrawCalls = 0;
+            benchmarkRestoreMode = renderMode;
+            benchmarkRestoreOcclusion = useOcclusionCulling;
+            std::cout << "Benchmark: " << buildings.size() << " buildings in " << batches.size() << " chunks, "
+                      << benchmarkFrames << " frames per mode" << std::endl;
+        }
+        if (benchmarkStage >= 0) {
+            renderMode = benchmarkModes[benchmarkStage];
+            useOcclusionCulling = false;
+        }
+
+        // Keep the road and sky around the camera; the road snaps to its 20 unit texture period
+        road.pos = glm::vec3(floor(eye.x / 20.0f) * 20.0f, 0.0f, floor(eye.z / 20.0f) * 20.0f);
+        skybox.pos = eye;
+
+        // Texture uploads and chunk loading above bind GL objects directly
+        InvalidateRenderState();
+        ResetRenderStateStats();
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         viewMatrix = glm::lookAt(eye, lookat, up);
@@ -763,33 +864,135 @@ int main(void) {
         glm::mat4 viewMatrix = glm::lookAt(eye, lookat, up);
         glm::mat4 cameraMatrix = projectionMatrix * viewMatrix;
 
-        for (auto &building : buildings) {
-            building.render(vp);
+        // Find the buildings inside the view frustum before issuing any GL calls
+        Frustum frustum = ExtractFrustum(vp);
+        visibleBuildings.clear();
+        CullingStats cullingStats = buildingBVH.cull(frustum, visibleBuildings);
+
+        // Skip buildings whose bounds were hidden when last queried; batches are drawn whole
+        bool occlusionActive = useOcclusionCulling && renderMode != RENDER_BATCHED;
+        OcclusionStats occlusionStats = { 0, 0, 0.0 };
+        if (occlusionActive) {
+            // Front to back, so near towers fill the depth buffer before the ones they hide
+            glm::vec3 cameraPosition = eye;
+            std::sort(visibleBuildings.begin(), visibleBuildings.end(), [&](int a, int b) {
+                return glm::dot(buildings[a].pos - cameraPosition, buildings[a].pos - cameraPosition) <
+                       glm::dot(buildings[b].pos - cameraPosition, buildings[b].pos - cameraPosition);
+            });
+            frustumVisibleBuildings = visibleBuildings;
+
+            int viewportWidth, viewportHeight;
+            glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+            occlusionStats = occlusionCuller.filter(visibleBuildings, buildingBounds, vp, eye, viewportWidth, viewportHeight);
         }
-        for (auto &building : buildings2) {
-            building.render(vp);
+
+        // Draw the buildings with one call each, one instanced call, or one call per chunk in view
+        double submitStart = glfwGetTime();
+        int drawCalls = 0;
+        if (renderMode == RENDER_BATCHED) {
+            visibleBatches.clear();
+            batchBVH.cull(frustum, visibleBatches);
+
+            // Sort by state so consecutive batches share program, texture and mesh where they can
+            drawOrder.clear();
+            for (int index : visibleBatches) {
+                drawOrder.push_back(std::make_pair(batches[index]->getSortKey(), index));
+            }
+            std::stable_sort(drawOrder.begin(), drawOrder.end(), [](const std::pair<DrawSortKey, int> &a, const std::pair<DrawSortKey, int> &b) {
+                return a.first < b.first;
+            });
+            for (const auto &draw : drawOrder) {
+                batches[draw.second]->render(vp);
+            }
+            drawCalls = (int)visibleBatches.size();
+        } else if (renderMode == RENDER_INSTANCED) {
+            buildingInstancer.render(vp, visibleBuildings);
+            drawCalls = visibleBuildings.empty() ? 0 : 1;
+        } else {
+            // Stable sort keeps the front-to-back order within each state group
+            drawOrder.clear();
+            for (int index : visibleBuildings) {
+                drawOrder.push_back(std::make_pair(buildings[index].getSortKey(), index));
+            }
+            std::stable_sort(drawOrder.begin(), drawOrder.end(), [](const std::pair<DrawSortKey, int> &a, const std::pair<DrawSortKey, int> &b) {
+                return a.first < b.first;
+            });
+            for (const auto &draw : drawOrder) {
+                buildings[draw.second].render(vp);
+            }
+            drawCalls = (int)visibleBuildings.size();
         }
-        for (auto &building : buildings3) {
-            building.render(vp);
+        double submitTime = glfwGetTime() - submitStart;
+
+        // Test the bounds of every building in view against this frame's depth buffer
+        if (occlusionActive) {
+            occlusionCuller.issueQueries(frustumVisibleBuildings, buildingBounds, vp, occlusionStats);
+        }
+
+        // Show the culling results in the window title twice a second
+        if (currentFrame - lastStatsTime > 0.5) {
+            lastStatsTime = currentFrame;
+            std::stringstream stream;
+            stream << "City | " << renderModeNames[renderMode] << " visible: " << cullingStats.visible
+                   << " culled: " << cullingStats.culled << " draw calls: " << drawCalls;
+            RenderStateStats stateStats = GetRenderStateStats();
+            stream << " GL calls skipped: " << stateStats.callsSkipped << "/" << (stateStats.callsSkipped + stateStats.callsIssued);
+            if (occlusionActive) {
+                // Each occluded building is one draw call saved on the per-building path
+                stream << " occluded: " << occlusionStats.occluded
+                       << " queries: " << occlusionStats.queriesIssued
+                       << " fragments saved: ~" << (int)(occlusionStats.fragmentsSaved / 1000) << "k";
+                if (renderMode == RENDER_PER_BUILDING) {
+                    stream << " draw calls saved: " << occlusionStats.occluded;
+                }
+            }
+            glfwSetWindowTitle(window, stream.str().c_str());
         }
         
         glm::mat4 viewProjection = vp * viewMatrix;
         glfwSwapBuffers(window);
+
+        // Accumulate the benchmark after the warm-up frames and report each mode when it finishes
+        if (benchmarkStage >= 0) {
+            if (benchmarkFrame >= benchmarkWarmupFrames) {
+                benchmarkSubmitTime += submitTime;
+                benchmarkFrameTime += glfwGetTime() - frameStart;
+                benchmarkDrawCalls += drawCalls;
+            }
+            if (++benchmarkFrame == benchmarkWarmupFrames + benchmarkFrames) {
+                std::cout << "  " << renderModeNames[renderMode] << ": "
+                          << 1000.0 * benchmarkSubmitTime / benchmarkFrames << " ms submit, "
+                          << 1000.0 * benchmarkFrameTime / benchmarkFrames << " ms frame, "
+                          << benchmarkDrawCalls / benchmarkFrames << " draw calls" << std::endl;
+                benchmarkFrame = 0;
+                benchmarkSubmitTime = benchmarkFrameTime = 0.0;
+                benchmarkDrawCalls = 0;
+                if (++benchmarkStage == 3) {
+                    benchmarkStage = -1;
+                    renderMode = benchmarkRestoreMode;
+                    useOcclusionCulling = benchmarkRestoreOcclusion;
+                }
+            }
+        }
+
         glfwPollEvents();
     } while (!glfwWindowShouldClose(window));
 
     // Clean up allocated resources for all buildings
-    for(auto &building : buildings) {
-        building.cleanup();
+    cityGenerator.shutdown();
+    for(auto &entry : chunkBuildings) {
+        for (auto &building : entry.second) {
+            building.cleanup();
+        }
     }
-
-    for(auto &building : buildings2) {
-        building.cleanup();
-    }
-
-    for(auto &building : buildings3) {
-        building.cleanup();
+    for (auto &entry : chunkBatches) {
+        entry.second.cleanup();
     }
+    buildingInstancer.cleanup();
+    occlusionCuller.cleanup();
+    road.cleanup();
+    skybox.cleanup();
+    ShutdownTextureLoader();
     // Terminate GLFW
     glfwTerminate();
     return 0;
@@ -822,6 +1025,25 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         lookat += right * moveSpeed;
         eye += right * moveSpeed;
     }
+    // Toggle between instanced and per-building rendering
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        renderMode = renderMode == RENDER_INSTANCED ? RENDER_PER_BUILDING : RENDER_INSTANCED;
+        std::cout << renderModeNames[renderMode] << " rendering" << std::endl;
+    }
+    // Toggle between merged chunk batches and instanced rendering
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        renderMode = renderMode == RENDER_BATCHED ? RENDER_INSTANCED : RENDER_BATCHED;
+        std::cout << renderModeNames[renderMode] << " rendering" << std::endl;
+    }
+    // Benchmark every render mode from the current view
+    if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+        benchmarkRequested = true;
+    }
+    // Toggle occlusion culling
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        useOcclusionCulling = !useOcclusionCulling;
+        std::cout << "Occlusion culling " << (useOcclusionCulling ? "on" : "off") << std::endl;
+    }
     // Close the window if Escape key is pressed
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GL_TRUE);
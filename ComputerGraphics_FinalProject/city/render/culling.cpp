@@ -0,0 +1,157 @@
+#include "culling.h"
+
+#include <algorithm>
+
+// Leaves hold up to this many boxes
+static const int MaxLeafItems = 4;
+
+enum FrustumTest {
+	OUTSIDE,
+	INTERSECTING,
+	INSIDE
+};
+
+Frustum ExtractFrustum(const glm::mat4 &viewProjection)
+{
+	// Gribb/Hartmann: each plane is the fourth row plus or minus another row
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = row3 + row2;
+	frustum.planes[5] = row3 - row2;
+	return frustum;
+}
+
+static FrustumTest TestAABB(const Frustum &frustum, const AABB &box)
+{
+	FrustumTest result = INSIDE;
+	for (int i = 0; i < 6; ++i) {
+		const glm::vec4 &plane = frustum.planes[i];
+
+		// Corner furthest along the plane normal, and the one furthest against it
+		glm::vec3 positive(plane.x >= 0 ? box.max.x : box.min.x,
+			plane.y >= 0 ? box.max.y : box.min.y,
+			plane.z >= 0 ? box.max.z : box.min.z);
+		glm::vec3 negative(plane.x >= 0 ? box.min.x : box.max.x,
+			plane.y >= 0 ? box.min.y : box.max.y,
+			plane.z >= 0 ? box.min.z : box.max.z);
+
+		if (glm::dot(glm::vec3(plane), positive) + plane.w < 0) {
+			return OUTSIDE;
+		}
+		if (glm::dot(glm::vec3(plane), negative) + plane.w < 0) {
+			result = INTERSECTING;
+		}
+	}
+	return result;
+}
+
+static AABB Merge(const AABB &a, const AABB &b)
+{
+	AABB merged;
+	merged.min = glm::min(a.min, b.min);
+	merged.max = glm::max(a.max, b.max);
+	return merged;
+}
+
+void BoundingVolumeHierarchy::build(const std::vector<AABB> &boxes)
+{
+	nodes.clear();
+	itemBounds = boxes;
+	itemIndices.resize(boxes.size());
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		itemIndices[i] = (int)i;
+	}
+
+	if (!boxes.empty()) {
+		nodes.reserve(2 * boxes.size() / MaxLeafItems + 1);
+		buildNode(0, (int)boxes.size());
+	}
+}
+
+int BoundingVolumeHierarchy::buildNode(int first, int count)
+{
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(Node());
+
+	AABB bounds = itemBounds[itemIndices[first]];
+	for (int i = first + 1; i < first + count; ++i) {
+		bounds = Merge(bounds, itemBounds[itemIndices[i]]);
+	}
+
+	Node node;
+	node.bounds = bounds;
+	node.left = -1;
+	node.right = -1;
+	node.first = first;
+	node.count = count;
+
+	if (count > MaxLeafItems) {
+		// Split at the median of the longest axis
+		glm::vec3 extent = bounds.max - bounds.min;
+		int axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		const std::vector<AABB> &boxes = itemBounds;
+		int middle = first + count / 2;
+		std::nth_element(itemIndices.begin() + first, itemIndices.begin() + middle, itemIndices.begin() + first + count,
+			[&boxes, axis](int a, int b) {
+				return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis];
+			});
+
+		node.left = buildNode(first, middle - first);
+		node.right = buildNode(middle, first + count - middle);
+	}
+
+	nodes[nodeIndex] = node;
+	return nodeIndex;
+}
+
+CullingStats BoundingVolumeHierarchy::cull(const Frustum &frustum, std::vector<int> &visible) const
+{
+	CullingStats stats = { 0, 0, 0 };
+	if (nodes.empty()) {
+		return stats;
+	}
+
+	size_t visibleBefore = visible.size();
+
+	// Iterative traversal; subtrees fully inside the frustum are accepted without further tests
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node &node = nodes[stack[--stackSize]];
+		stats.nodesTested++;
+
+		FrustumTest test = TestAABB(frustum, node.bounds);
+		if (test == OUTSIDE) {
+			continue;
+		}
+
+		if (test == INSIDE) {
+			visible.insert(visible.end(), itemIndices.begin() + node.first, itemIndices.begin() + node.first + node.count);
+		} else if (node.left < 0) {
+			for (int i = node.first; i < node.first + node.count; ++i) {
+				if (TestAABB(frustum, itemBounds[itemIndices[i]]) != OUTSIDE) {
+					visible.push_back(itemIndices[i]);
+				}
+			}
+		} else {
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.right;
+		}
+	}
+
+	stats.visible = (int)(visible.size() - visibleBefore);
+	stats.culled = (int)itemBounds.size() - stats.visible;
+	return stats;
+}
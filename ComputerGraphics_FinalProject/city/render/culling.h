@@ -0,0 +1,51 @@
+#ifndef _CULLING_H_
+#define _CULLING_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Axis-aligned bounding box
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Six planes (left, right, bottom, top, near, far) pointing into the frustum
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// Extract the frustum planes from a projection * view matrix
+Frustum ExtractFrustum(const glm::mat4 &viewProjection);
+
+// Per-frame culling counters
+struct CullingStats {
+	int visible;
+	int culled;
+	int nodesTested;
+};
+
+// Bounding volume hierarchy over a static set of boxes, queried against a frustum
+// before any GL work so the cost scales with what is on screen.
+struct BoundingVolumeHierarchy {
+	struct Node {
+		AABB bounds;
+		int left;		// Child node indices, -1 for leaves
+		int right;
+		int first;		// Range in itemIndices covered by a leaf
+		int count;
+	};
+	std::vector<Node> nodes;
+	std::vector<int> itemIndices;
+	std::vector<AABB> itemBounds;
+
+	// Build the hierarchy; item i is reported back as index i by cull()
+	void build(const std::vector<AABB> &boxes);
+
+	// Append the indices of the boxes intersecting the frustum to visible
+	CullingStats cull(const Frustum &frustum, std::vector<int> &visible) const;
+
+	int buildNode(int first, int count);
+};
+
+#endif
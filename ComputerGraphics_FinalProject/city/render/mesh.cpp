@@ -0,0 +1,193 @@
+#include "mesh.h"
+#include "state.h"
+
+#include <glm/gtc/packing.hpp>
+#include <iostream>
+#include <string>
+#include <map>
+#include <cstring>
+
+// Registry entry for a shared mesh
+struct SharedMesh {
+	Mesh mesh;
+	int refCount;
+};
+
+static std::map<std::string, SharedMesh> sharedMeshes;
+
+static size_t ComponentSize(MeshAttributeType type)
+{
+	return type == MESH_FLOAT ? 4 : 2;
+}
+
+static GLenum ComponentType(MeshAttributeType type)
+{
+	switch (type) {
+	case MESH_HALF: return GL_HALF_FLOAT;
+	case MESH_SNORM16: return GL_SHORT;
+	case MESH_UNORM16: return GL_UNSIGNED_SHORT;
+	default: return GL_FLOAT;
+	}
+}
+
+// Attributes start on 4-byte boundaries
+static size_t AlignedSize(MeshAttributeType type, int components)
+{
+	return (ComponentSize(type) * components + 3) & ~(size_t)3;
+}
+
+// Write one component, returning false if a normalized value had to be clamped
+static bool PackComponent(unsigned char *out, MeshAttributeType type, float value)
+{
+	if (type == MESH_FLOAT) {
+		memcpy(out, &value, 4);
+		return true;
+	}
+
+	glm::uint16 packed;
+	bool inRange = true;
+	if (type == MESH_HALF) {
+		packed = glm::packHalf1x16(value);
+	} else if (type == MESH_SNORM16) {
+		packed = glm::packSnorm1x16(value);
+		inRange = value >= -1.0f && value <= 1.0f;
+	} else {
+		packed = glm::packUnorm1x16(value);
+		inRange = value >= 0.0f && value <= 1.0f;
+	}
+	memcpy(out, &packed, 2);
+	return inRange;
+}
+
+static void SetAttributes(const Mesh &mesh)
+{
+	MeshAttributeType positionType = mesh.format.position;
+	MeshAttributeType uvType = mesh.format.uv;
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, ComponentType(positionType), positionType == MESH_SNORM16 || positionType == MESH_UNORM16,
+		mesh.stride, (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, ComponentType(uvType), uvType == MESH_SNORM16 || uvType == MESH_UNORM16,
+		mesh.stride, (void*)AlignedSize(positionType, 3));
+}
+
+Mesh CreateMesh(const MeshData &data, const MeshFormat &format)
+{
+	Mesh mesh;
+	mesh.primitive = data.primitive;
+	mesh.format = format;
+	size_t uvOffset = AlignedSize(format.position, 3);
+	mesh.stride = (GLsizei)(uvOffset + AlignedSize(format.uv, 2));
+
+	// Interleave the attributes, a missing UV is left at zero
+	size_t vertexCount = data.positions.size();
+	std::vector<unsigned char> vertices(vertexCount * mesh.stride, 0);
+	bool inRange = true;
+	for (size_t i = 0; i < vertexCount; ++i) {
+		unsigned char *vertex = &vertices[i * mesh.stride];
+		for (int c = 0; c < 3; ++c) {
+			inRange &= PackComponent(vertex + c * ComponentSize(format.position), format.position, data.positions[i][c]);
+		}
+		if (i < data.uvs.size()) {
+			for (int c = 0; c < 2; ++c) {
+				inRange &= PackComponent(vertex + uvOffset + c * ComponentSize(format.uv), format.uv, data.uvs[i][c]);
+			}
+		}
+	}
+	if (!inRange) {
+		std::cerr << "Mesh values outside the normalized range were clamped" << std::endl;
+	}
+
+	glGenVertexArrays(1, &mesh.vertexArrayID);
+	BindVertexArrayCached(mesh.vertexArrayID);
+
+	glGenBuffers(1, &mesh.vertexBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferID);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	mesh.bytes = vertices.size();
+
+	mesh.indexBufferID = 0;
+	mesh.indexType = 0;
+	mesh.count = (GLsizei)vertexCount;
+	if (!data.indices.empty()) {
+		glGenBuffers(1, &mesh.indexBufferID);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferID);
+		mesh.count = (GLsizei)data.indices.size();
+
+		// Halve the index buffer when every vertex is reachable with 16 bits
+		if (vertexCount <= 65536) {
+			std::vector<GLushort> shortIndices(data.indices.begin(), data.indices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+			mesh.indexType = GL_UNSIGNED_SHORT;
+			mesh.bytes += shortIndices.size() * sizeof(GLushort);
+		} else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(GLuint), data.indices.data(), GL_STATIC_DRAW);
+			mesh.indexType = GL_UNSIGNED_INT;
+			mesh.bytes += data.indices.size() * sizeof(GLuint);
+		}
+	}
+
+	SetAttributes(mesh);
+	BindVertexArrayCached(0);
+
+	return mesh;
+}
+
+void AttachMesh(const Mesh &mesh)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferID);
+	if (mesh.indexBufferID != 0) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferID);
+	}
+	SetAttributes(mesh);
+}
+
+void DrawMesh(const Mesh &mesh)
+{
+	BindVertexArrayCached(mesh.vertexArrayID);
+	if (mesh.indexBufferID != 0) {
+		glDrawElements(mesh.primitive, mesh.count, mesh.indexType, (void*)0);
+	} else {
+		glDrawArrays(mesh.primitive, 0, mesh.count);
+	}
+}
+
+void DestroyMesh(Mesh &mesh)
+{
+	glDeleteBuffers(1, &mesh.vertexBufferID);
+	if (mesh.indexBufferID != 0) {
+		glDeleteBuffers(1, &mesh.indexBufferID);
+	}
+	glDeleteVertexArrays(1, &mesh.vertexArrayID);
+	mesh.vertexArrayID = mesh.vertexBufferID = mesh.indexBufferID = 0;
+}
+
+Mesh AcquireMesh(const char *name, MeshData (*build)(), const MeshFormat &format)
+{
+	std::map<std::string, SharedMesh>::iterator found = sharedMeshes.find(name);
+	if (found != sharedMeshes.end()) {
+		found->second.refCount++;
+		return found->second.mesh;
+	}
+
+	SharedMesh shared;
+	shared.mesh = CreateMesh(build(), format);
+	shared.refCount = 1;
+	sharedMeshes[name] = shared;
+	return shared.mesh;
+}
+
+void ReleaseMesh(const Mesh &mesh)
+{
+	for (std::map<std::string, SharedMesh>::iterator it = sharedMeshes.begin(); it != sharedMeshes.end(); ++it) {
+		if (it->second.mesh.vertexArrayID == mesh.vertexArrayID) {
+			// Delete the buffers once the last user releases them
+			if (--it->second.refCount == 0) {
+				DestroyMesh(it->second.mesh);
+				sharedMeshes.erase(it);
+			}
+			return;
+		}
+	}
+}
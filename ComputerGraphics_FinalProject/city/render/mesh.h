@@ -0,0 +1,61 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Storage of a vertex attribute in the interleaved buffer
+enum MeshAttributeType {
+	MESH_FLOAT,		// 32-bit floats
+	MESH_HALF,		// 16-bit floats, exact for integers up to 2048
+	MESH_SNORM16,	// Normalized shorts for values in [-1, 1]
+	MESH_UNORM16	// Normalized unsigned shorts for values in [0, 1]
+};
+
+struct MeshFormat {
+	MeshAttributeType position;
+	MeshAttributeType uv;
+};
+
+// Source geometry, expanded into the interleaved layout by CreateMesh
+struct MeshData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<GLuint> indices;	// Empty to draw the vertices in order
+	GLenum primitive;
+};
+
+// Interleaved vertex buffer and its VAO: position at attribute 0, UV at attribute 1.
+// Small enough to copy around as a handle.
+struct Mesh {
+	GLuint vertexArrayID;
+	GLuint vertexBufferID;
+	GLuint indexBufferID;		// 0 when drawn without indices
+	GLenum primitive;
+	GLenum indexType;			// GL_UNSIGNED_SHORT when every index fits in 16 bits
+	GLsizei count;				// Indices, or vertices without an index buffer
+	GLsizei stride;
+	MeshFormat format;
+	size_t bytes;				// Vertex and index memory
+};
+
+Mesh CreateMesh(const MeshData &data, const MeshFormat &format);
+
+// Bind the mesh buffers and attribute pointers into the currently bound VAO,
+// for VAOs that add their own attributes (e.g. instance data)
+void AttachMesh(const Mesh &mesh);
+
+// Bind the mesh VAO and draw it
+void DrawMesh(const Mesh &mesh);
+
+void DestroyMesh(Mesh &mesh);
+
+// Shared meshes: built once per name on first use and reference counted,
+// so every object drawing the same shape uses the same buffers.
+Mesh AcquireMesh(const char *name, MeshData (*build)(), const MeshFormat &format);
+
+void ReleaseMesh(const Mesh &mesh);
+
+#endif
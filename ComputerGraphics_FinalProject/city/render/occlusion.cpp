@@ -0,0 +1,197 @@
+#include "occlusion.h"
+#include "shader.h"
+#include "state.h"
+
+#include <algorithm>
+
+// Corners of the unit cube used as the query proxy
+static const GLfloat proxyVertices[24] = {
+	-1.0f, -1.0f, -1.0f,
+	1.0f, -1.0f, -1.0f,
+	1.0f, 1.0f, -1.0f,
+	-1.0f, 1.0f, -1.0f,
+	-1.0f, -1.0f, 1.0f,
+	1.0f, -1.0f, 1.0f,
+	1.0f, 1.0f, 1.0f,
+	-1.0f, 1.0f, 1.0f,
+};
+
+static const GLuint proxyIndices[36] = {
+	0, 1, 2, 0, 2, 3,
+	4, 6, 5, 4, 7, 6,
+	0, 4, 5, 0, 5, 1,
+	3, 2, 6, 3, 6, 7,
+	0, 3, 7, 0, 7, 4,
+	1, 5, 6, 1, 6, 2,
+};
+
+void OcclusionCuller::initialize(int itemCount)
+{
+	frame = 0;
+	visibleQueryInterval = 4;
+	resize(itemCount);
+
+	// Proxy cube, positions only
+	glGenVertexArrays(1, &vertexArrayID);
+	glBindVertexArray(vertexArrayID);
+
+	glGenBuffers(1, &vertexBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(proxyVertices), proxyVertices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glGenBuffers(1, &indexBufferID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(proxyIndices), proxyIndices, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+
+	programID = AcquireShaderProgram("../city/bbox.vert", "../city/bbox.frag");
+	vpMatrixID = GetCachedUniformLocation(programID, "VP");
+	boxCenterID = GetCachedUniformLocation(programID, "boxCenter");
+	boxExtentID = GetCachedUniformLocation(programID, "boxExtent");
+}
+
+void OcclusionCuller::resize(int itemCount)
+{
+	if (!queries.empty()) {
+		glDeleteQueries((GLsizei)queries.size(), queries.data());
+	}
+	queries.resize(itemCount);
+	if (itemCount > 0) {
+		glGenQueries(itemCount, queries.data());
+	}
+	pending.assign(itemCount, 0);
+	occluded.assign(itemCount, 0);
+	lastSeenFrame.assign(itemCount, -2);
+}
+
+// Screen area covered by a box, used to estimate the fragments an occluded item would have shaded
+static double ProjectedArea(const AABB &box, const glm::mat4 &viewProjection, int viewportWidth, int viewportHeight)
+{
+	glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+	for (int i = 0; i < 8; ++i) {
+		glm::vec4 corner((i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z, 1.0f);
+		glm::vec4 clip = viewProjection * corner;
+
+		// A corner behind the camera can cover the whole screen
+		if (clip.w <= 0.0f) {
+			return (double)viewportWidth * viewportHeight;
+		}
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+	ndcMin = glm::clamp(ndcMin, glm::vec2(-1.0f), glm::vec2(1.0f));
+	ndcMax = glm::clamp(ndcMax, glm::vec2(-1.0f), glm::vec2(1.0f));
+	glm::vec2 size = glm::max(ndcMax - ndcMin, glm::vec2(0.0f));
+	return 0.25 * size.x * viewportWidth * size.y * viewportHeight;
+}
+
+OcclusionStats OcclusionCuller::filter(std::vector<int> &visible, const std::vector<AABB> &bounds,
+	const glm::mat4 &viewProjection, const glm::vec3 &eye, int viewportWidth, int viewportHeight)
+{
+	OcclusionStats stats = { 0, 0, 0.0 };
+	frame++;
+
+	// Read back every query whose result is ready, never waiting on the GPU
+	for (size_t i = 0; i < queries.size(); ++i) {
+		if (!pending[i]) {
+			continue;
+		}
+		GLuint available = 0;
+		glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint anySamplesPassed = 0;
+			glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &anySamplesPassed);
+			occluded[i] = anySamplesPassed ? 0 : 1;
+			pending[i] = 0;
+		}
+	}
+
+	size_t kept = 0;
+	for (size_t k = 0; k < visible.size(); ++k) {
+		int index = visible[k];
+		const AABB &box = bounds[index];
+
+		// Items that just entered the frustum have a stale result, and a camera inside the
+		// box would have its proxy clipped away, so both are treated as visible
+		bool enteredView = lastSeenFrame[index] != frame - 1;
+		bool eyeInside = glm::all(glm::greaterThanEqual(eye, box.min)) && glm::all(glm::lessThanEqual(eye, box.max));
+		lastSeenFrame[index] = frame;
+		if (enteredView || eyeInside) {
+			occluded[index] = 0;
+		}
+
+		if (occluded[index]) {
+			stats.occluded++;
+			stats.fragmentsSaved += ProjectedArea(box, viewProjection, viewportWidth, viewportHeight);
+		} else {
+			visible[kept++] = index;
+		}
+	}
+	visible.resize(kept);
+
+	return stats;
+}
+
+void OcclusionCuller::issueQueries(const std::vector<int> &candidates, const std::vector<AABB> &bounds,
+	const glm::mat4 &viewProjection, OcclusionStats &stats)
+{
+	UseProgramCached(programID);
+	BindVertexArrayCached(vertexArrayID);
+	glUniformMatrix4fv(vpMatrixID, 1, GL_FALSE, &viewProjection[0][0]);
+
+	// Depth test only; pull proxies slightly toward the camera so a drawn box does not hide its own proxy
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(-1.0f, -1.0f);
+
+	for (size_t k = 0; k < candidates.size(); ++k) {
+		int index = candidates[k];
+		if (pending[index]) {
+			continue;
+		}
+
+		// Hidden items are tested every frame so they reappear promptly,
+		// visible ones are spread over several frames
+		if (!occluded[index] && (frame + index) % visibleQueryInterval != 0) {
+			continue;
+		}
+
+		const AABB &box = bounds[index];
+		glm::vec3 center = 0.5f * (box.min + box.max);
+		glm::vec3 extent = 0.5f * (box.max - box.min);
+		glUniform3fv(boxCenterID, 1, &center[0]);
+		glUniform3fv(boxExtentID, 1, &extent[0]);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[index]);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		pending[index] = 1;
+		stats.queriesIssued++;
+	}
+
+	// Restore the scene state
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glEnable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void OcclusionCuller::cleanup()
+{
+	if (!queries.empty()) {
+		glDeleteQueries((GLsizei)queries.size(), queries.data());
+	}
+	glDeleteBuffers(1, &vertexBufferID);
+	glDeleteBuffers(1, &indexBufferID);
+	glDeleteVertexArrays(1, &vertexArrayID);
+	ReleaseShaderProgram(programID);
+}
@@ -0,0 +1,54 @@
+#ifndef _OCCLUSION_H_
+#define _OCCLUSION_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "culling.h"
+
+// Per-frame occlusion counters
+struct OcclusionStats {
+	int occluded;			// Frustum-visible items skipped because they were hidden last time
+	int queriesIssued;		// Bounding box queries sent this frame
+	double fragmentsSaved;	// Estimated screen pixels of the skipped items
+};
+
+// Hardware occlusion culling with GL_ANY_SAMPLES_PASSED queries on bounding boxes.
+// Results are read back a frame or more later without waiting, so the GPU never stalls;
+// an item is drawn until a finished query reports its box hidden behind the scene.
+struct OcclusionCuller {
+	std::vector<GLuint> queries;		// One query object per item
+	std::vector<char> pending;			// Query issued, result not read yet
+	std::vector<char> occluded;			// Last result read back
+	std::vector<int> lastSeenFrame;		// Last frame the item passed frustum culling
+	int frame;
+
+	// Re-query items that are visible only every few frames, hidden ones every frame
+	int visibleQueryInterval;
+
+	// Proxy cube and depth-only program
+	GLuint vertexArrayID;
+	GLuint vertexBufferID;
+	GLuint indexBufferID;
+	GLuint programID;
+	GLint vpMatrixID;
+	GLint boxCenterID;
+	GLint boxExtentID;
+
+	void initialize(int itemCount);
+
+	// Start over with a new set of items, forgetting all previous results
+	void resize(int itemCount);
+
+	// Read back finished queries, then remove items known to be hidden from visible
+	OcclusionStats filter(std::vector<int> &visible, const std::vector<AABB> &bounds,
+		const glm::mat4 &viewProjection, const glm::vec3 &eye, int viewportWidth, int viewportHeight);
+
+	// Draw the bounding boxes of the frustum-visible items against the finished depth buffer
+	void issueQueries(const std::vector<int> &candidates, const std::vector<AABB> &bounds,
+		const glm::mat4 &viewProjection, OcclusionStats &stats);
+
+	void cleanup();
+};
+
+#endif
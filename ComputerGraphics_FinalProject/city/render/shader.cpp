@@ -5,6 +5,8 @@
 #include <fstream>
 #include <sstream> 
 #include <vector>
+#include <map>
+#include <utility>
 #include <stb/stb_image.h>
 
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
@@ -195,4 +197,84 @@ GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentS
 	return ProgramID;
 }
 
+// Registry entry for one linked program
+struct RegisteredProgram {
+	std::pair<std::string, std::string> key;
+	int refCount;
+	std::map<std::string, GLint> uniformLocations;
+};
 
+static std::map<std::pair<std::string, std::string>, GLuint> registryByPath;
+static std::map<GLuint, RegisteredProgram> registryByProgram;
+static ShaderRegistryStats registryStats = { 0, 0, 0 };
+
+GLuint AcquireShaderProgram(const char *vertex_file_path, const char *fragment_file_path)
+{
+	std::pair<std::string, std::string> key(vertex_file_path, fragment_file_path);
+
+	// Reuse the program if these shaders were already linked
+	std::map<std::pair<std::string, std::string>, GLuint>::iterator found = registryByPath.find(key);
+	if (found != registryByPath.end()) {
+		registryByProgram[found->second].refCount++;
+		registryStats.compilesAvoided++;
+		return found->second;
+	}
+
+	// Failed programs are not cached so a fixed shader can be retried
+	GLuint ProgramID = LoadShadersFromFile(vertex_file_path, fragment_file_path);
+	if (ProgramID == 0) {
+		return 0;
+	}
+
+	RegisteredProgram entry;
+	entry.key = key;
+	entry.refCount = 1;
+	registryByProgram[ProgramID] = entry;
+	registryByPath[key] = ProgramID;
+	registryStats.programsCompiled++;
+	registryStats.livePrograms++;
+
+	return ProgramID;
+}
+
+void ReleaseShaderProgram(GLuint programID)
+{
+	std::map<GLuint, RegisteredProgram>::iterator found = registryByProgram.find(programID);
+	if (found == registryByProgram.end()) {
+		// Not owned by the registry
+		glDeleteProgram(programID);
+		return;
+	}
+
+	// Delete the program once its last user releases it
+	if (--found->second.refCount == 0) {
+		registryByPath.erase(found->second.key);
+		registryByProgram.erase(found);
+		registryStats.livePrograms--;
+		glDeleteProgram(programID);
+	}
+}
+
+GLint GetCachedUniformLocation(GLuint programID, const char *name)
+{
+	std::map<GLuint, RegisteredProgram>::iterator found = registryByProgram.find(programID);
+	if (found == registryByProgram.end()) {
+		return glGetUniformLocation(programID, name);
+	}
+
+	// Query the driver only the first time a uniform is looked up
+	std::map<std::string, GLint> &locations = found->second.uniformLocations;
+	std::map<std::string, GLint>::iterator location = locations.find(name);
+	if (location != locations.end()) {
+		return location->second;
+	}
+
+	GLint uniformLocation = glGetUniformLocation(programID, name);
+	locations[name] = uniformLocation;
+	return uniformLocation;
+}
+
+ShaderRegistryStats GetShaderRegistryStats()
+{
+	return registryStats;
+}
@@ -8,6 +8,21 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
 
+// Shared program registry: programs are compiled once per (vertex, fragment) path pair
+// and reference counted, so every object using the same shaders gets the same program.
+struct ShaderRegistryStats {
+	int programsCompiled;	// Programs actually compiled and linked
+	int compilesAvoided;	// Acquires served from the registry
+	int livePrograms;		// Programs still referenced
+};
+
+GLuint AcquireShaderProgram(const char *vertex_file_path, const char *fragment_file_path);
+
+void ReleaseShaderProgram(GLuint programID);
+
+GLint GetCachedUniformLocation(GLuint programID, const char *name);
+
+ShaderRegistryStats GetShaderRegistryStats();
 
 
 #endif
@@ -0,0 +1,153 @@
+#include "state.h"
+
+#include <unordered_map>
+
+static const GLuint MaxTextureUnits = 16;
+
+// Last state sent to GL; valid is false until the first call after an invalidate
+struct TrackedState {
+	bool programValid;
+	GLuint program;
+	bool vertexArrayValid;
+	GLuint vertexArray;
+	bool activeUnitValid;
+	GLuint activeUnit;
+	bool textureValid[MaxTextureUnits];
+	GLuint textures[MaxTextureUnits];
+
+	// Uniform values keyed by (program, location)
+	std::unordered_map<unsigned long long, GLint> uniformInts;
+	std::unordered_map<unsigned long long, unsigned long long> uniformVec2s;
+
+	RenderStateStats stats;
+};
+
+static TrackedState trackedState;
+
+static unsigned long long UniformKey(GLuint programID, GLint location)
+{
+	return ((unsigned long long)programID << 32) | (unsigned int)location;
+}
+
+void UseProgramCached(GLuint programID)
+{
+	if (trackedState.programValid && trackedState.program == programID) {
+		trackedState.stats.callsSkipped++;
+		return;
+	}
+	glUseProgram(programID);
+	trackedState.programValid = true;
+	trackedState.program = programID;
+	trackedState.stats.callsIssued++;
+}
+
+void BindVertexArrayCached(GLuint vertexArrayID)
+{
+	if (trackedState.vertexArrayValid && trackedState.vertexArray == vertexArrayID) {
+		trackedState.stats.callsSkipped++;
+		return;
+	}
+	glBindVertexArray(vertexArrayID);
+	trackedState.vertexArrayValid = true;
+	trackedState.vertexArray = vertexArrayID;
+	trackedState.stats.callsIssued++;
+}
+
+void BindTextureCached(GLuint unit, GLuint textureID)
+{
+	if (unit >= MaxTextureUnits) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		trackedState.activeUnitValid = false;
+		trackedState.stats.callsIssued += 2;
+		return;
+	}
+
+	if (trackedState.textureValid[unit] && trackedState.textures[unit] == textureID) {
+		trackedState.stats.callsSkipped++;
+		return;
+	}
+	if (!trackedState.activeUnitValid || trackedState.activeUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		trackedState.activeUnitValid = true;
+		trackedState.activeUnit = unit;
+		trackedState.stats.callsIssued++;
+	} else {
+		trackedState.stats.callsSkipped++;
+	}
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	trackedState.textureValid[unit] = true;
+	trackedState.textures[unit] = textureID;
+	trackedState.stats.callsIssued++;
+}
+
+void SetUniform1iCached(GLuint programID, GLint location, GLint value)
+{
+	unsigned long long key = UniformKey(programID, location);
+	std::unordered_map<unsigned long long, GLint>::iterator found = trackedState.uniformInts.find(key);
+	if (found != trackedState.uniformInts.end() && found->second == value) {
+		trackedState.stats.callsSkipped++;
+		return;
+	}
+
+	// glUniform* applies to the program in use
+	UseProgramCached(programID);
+	glUniform1i(location, value);
+	trackedState.uniformInts[key] = value;
+	trackedState.stats.callsIssued++;
+}
+
+void SetUniform2fCached(GLuint programID, GLint location, float x, float y)
+{
+	// Compare the bit patterns of both floats at once
+	union {
+		float values[2];
+		unsigned long long bits;
+	} packed;
+	packed.values[0] = x;
+	packed.values[1] = y;
+
+	unsigned long long key = UniformKey(programID, location);
+	std::unordered_map<unsigned long long, unsigned long long>::iterator found = trackedState.uniformVec2s.find(key);
+	if (found != trackedState.uniformVec2s.end() && found->second == packed.bits) {
+		trackedState.stats.callsSkipped++;
+		return;
+	}
+
+	UseProgramCached(programID);
+	glUniform2f(location, x, y);
+	trackedState.uniformVec2s[key] = packed.bits;
+	trackedState.stats.callsIssued++;
+}
+
+void InvalidateRenderState()
+{
+	trackedState.programValid = false;
+	trackedState.vertexArrayValid = false;
+	trackedState.activeUnitValid = false;
+	for (GLuint i = 0; i < MaxTextureUnits; ++i) {
+		trackedState.textureValid[i] = false;
+	}
+
+	// Program names can be reused after a release, so drop the uniform values as well
+	trackedState.uniformInts.clear();
+	trackedState.uniformVec2s.clear();
+}
+
+RenderStateStats GetRenderStateStats()
+{
+	return trackedState.stats;
+}
+
+void ResetRenderStateStats()
+{
+	trackedState.stats.callsIssued = 0;
+	trackedState.stats.callsSkipped = 0;
+}
+
+DrawSortKey MakeDrawSortKey(GLuint programID, GLuint textureID, GLuint vertexArrayID)
+{
+	// 21 bits per name is far more than the city ever creates
+	const unsigned long long mask = (1ull << 21) - 1;
+	return ((programID & mask) << 42) | ((textureID & mask) << 21) | (vertexArrayID & mask);
+}
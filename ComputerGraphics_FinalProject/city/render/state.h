@@ -0,0 +1,40 @@
+#ifndef _STATE_H_
+#define _STATE_H_
+
+#include <glad/gl.h>
+
+// Thin GL state tracker: remembers the bound program, VAO, textures and sampler-style
+// uniforms and drops calls that would set what is already set.
+// Code that changes this state with plain GL calls (texture uploads, mesh creation)
+// must call InvalidateRenderState() before the next cached call.
+struct RenderStateStats {
+	int callsIssued;		// GL calls passed through to the driver
+	int callsSkipped;		// Redundant calls filtered out
+};
+
+void UseProgramCached(GLuint programID);
+
+void BindVertexArrayCached(GLuint vertexArrayID);
+
+// Bind a 2D texture to a texture unit (0 for GL_TEXTURE0)
+void BindTextureCached(GLuint unit, GLuint textureID);
+
+// Uniforms are program state, so they are remembered per program and location
+void SetUniform1iCached(GLuint programID, GLint location, GLint value);
+
+void SetUniform2fCached(GLuint programID, GLint location, float x, float y);
+
+// Forget all tracked state; the next cached call of each kind always reaches GL
+void InvalidateRenderState();
+
+RenderStateStats GetRenderStateStats();
+
+void ResetRenderStateStats();
+
+// Sort key ordering draws by program, then texture, then mesh, so sorted draws change
+// the most expensive state least often
+typedef unsigned long long DrawSortKey;
+
+DrawSortKey MakeDrawSortKey(GLuint programID, GLuint textureID, GLuint vertexArrayID);
+
+#endif
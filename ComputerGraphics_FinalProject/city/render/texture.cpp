@@ -0,0 +1,324 @@
+#include "texture.h"
+
+#include <string>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+// Cache key: canonical path plus the sampler parameters
+typedef std::tuple<std::string, GLint, GLint, GLint, GLint> TextureKey;
+
+// Cache entry for one GL texture
+struct CachedTexture {
+	TextureKey key;
+	int refCount;
+	size_t bytes;
+	unsigned int loadID;	// Matches the decode job that fills this texture
+	bool mipmapped;
+	bool uploaded;
+};
+
+struct TextureCache {
+	std::map<TextureKey, GLuint> byKey;
+	std::map<GLuint, CachedTexture> byTexture;
+	TextureCacheStats stats;
+	unsigned int nextLoadID;
+};
+
+static TextureCache textureCache = { {}, {}, { 0, 0, 0, 0, 0 }, 1 };
+
+// Image to decode on a worker thread, and later upload on the GL thread
+struct DecodeJob {
+	GLuint texture;
+	unsigned int loadID;
+	std::string path;
+	int width;
+	int height;
+	unsigned char *pixels;				// Owned by stbi until uploaded, NULL if decoding failed
+};
+
+// Worker threads and their queues
+struct TextureLoader {
+	std::vector<std::thread> workers;
+	std::deque<DecodeJob> pending;
+	std::deque<DecodeJob> decoded;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+static TextureLoader textureLoader;
+
+TextureSampler DefaultTextureSampler()
+{
+	TextureSampler sampler;
+	sampler.wrapS = GL_REPEAT;
+	sampler.wrapT = GL_REPEAT;
+	sampler.minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	sampler.magFilter = GL_LINEAR;
+	return sampler;
+}
+
+// Resolve "../city/x.jpg" and "../city/./x.jpg" to the same cache entry
+static std::string CanonicalTexturePath(const char *texture_file_path)
+{
+#ifdef _WIN32
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, texture_file_path, _MAX_PATH) != NULL) {
+		return resolved;
+	}
+#else
+	char resolved[PATH_MAX];
+	if (realpath(texture_file_path, resolved) != NULL) {
+		return resolved;
+	}
+#endif
+	// Missing files keep their original path
+	return texture_file_path;
+}
+
+static bool UsesMipmaps(GLint minFilter)
+{
+	return minFilter == GL_NEAREST_MIPMAP_NEAREST || minFilter == GL_LINEAR_MIPMAP_NEAREST ||
+		minFilter == GL_NEAREST_MIPMAP_LINEAR || minFilter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+// Size of an RGB texture with its full mip chain
+static size_t TextureBytes(int w, int h, bool mipmapped)
+{
+	size_t bytes = 0;
+	while (true) {
+		bytes += (size_t)w * h * 3;
+		if (!mipmapped || (w == 1 && h == 1)) {
+			break;
+		}
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	return bytes;
+}
+
+// Decode queued images, handing stbi's buffer straight to the upload
+static void DecodeWorker()
+{
+	while (true) {
+		DecodeJob job;
+		{
+			std::unique_lock<std::mutex> lock(textureLoader.mutex);
+			textureLoader.wake.wait(lock, [] { return textureLoader.stopping || !textureLoader.pending.empty(); });
+			if (textureLoader.stopping) {
+				return;
+			}
+			job = std::move(textureLoader.pending.front());
+			textureLoader.pending.pop_front();
+		}
+
+		// Load image with 3 color channels (RGB), without flipping
+		int channels;
+		job.pixels = stbi_load(job.path.c_str(), &job.width, &job.height, &channels, 3);
+		if (!job.pixels) {
+			job.width = job.height = 0;
+		}
+
+		std::lock_guard<std::mutex> lock(textureLoader.mutex);
+		textureLoader.decoded.push_back(std::move(job));
+	}
+}
+
+static void StartTextureLoader()
+{
+	// stbi_load reads this flag from every thread, set it once up front
+	stbi_set_flip_vertically_on_load(false);
+
+	// Leave one core for the render thread
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	threadCount = threadCount > 1 ? threadCount - 1 : 1;
+
+	textureLoader.stopping = false;
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		textureLoader.workers.push_back(std::thread(DecodeWorker));
+	}
+}
+
+// Create the texture with its sampler parameters and a 1x1 placeholder image
+static GLuint CreatePlaceholderTexture(const TextureSampler &sampler)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// Set texture wrapping and filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+
+	// A single grey texel is a complete mip chain on its own
+	const unsigned char grey[3] = { 128, 128, 128 };
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+
+	return texture;
+}
+
+GLuint AcquireTexture(const char *texture_file_path, const TextureSampler &sampler)
+{
+	TextureKey key(CanonicalTexturePath(texture_file_path),
+		sampler.wrapS, sampler.wrapT, sampler.minFilter, sampler.magFilter);
+
+	// Share the texture if this image was already uploaded with the same sampler
+	std::map<TextureKey, GLuint>::iterator found = textureCache.byKey.find(key);
+	if (found != textureCache.byKey.end()) {
+		textureCache.byTexture[found->second].refCount++;
+		textureCache.stats.hits++;
+		return found->second;
+	}
+
+	if (textureLoader.workers.empty()) {
+		StartTextureLoader();
+	}
+
+	CachedTexture entry;
+	entry.key = key;
+	entry.refCount = 1;
+	entry.bytes = 0;
+	entry.loadID = textureCache.nextLoadID++;
+	entry.mipmapped = UsesMipmaps(sampler.minFilter);
+	entry.uploaded = false;
+	GLuint texture = CreatePlaceholderTexture(sampler);
+
+	textureCache.byKey[key] = texture;
+	textureCache.byTexture[texture] = entry;
+	textureCache.stats.misses++;
+	textureCache.stats.liveTextures++;
+	textureCache.stats.pendingUploads++;
+
+	// Hand the decode to the worker threads
+	DecodeJob job;
+	job.texture = texture;
+	job.loadID = entry.loadID;
+	job.path = texture_file_path;
+	job.pixels = NULL;
+	{
+		std::lock_guard<std::mutex> lock(textureLoader.mutex);
+		textureLoader.pending.push_back(std::move(job));
+	}
+	textureLoader.wake.notify_one();
+
+	return texture;
+}
+
+GLuint AcquireTexture(const char *texture_file_path)
+{
+	return AcquireTexture(texture_file_path, DefaultTextureSampler());
+}
+
+void ReleaseTexture(GLuint textureID)
+{
+	std::map<GLuint, CachedTexture>::iterator found = textureCache.byTexture.find(textureID);
+	if (found == textureCache.byTexture.end()) {
+		// Not owned by the cache
+		glDeleteTextures(1, &textureID);
+		return;
+	}
+
+	// Delete the texture once its last user releases it, a decode still in flight is dropped on upload
+	if (--found->second.refCount == 0) {
+		if (!found->second.uploaded) {
+			textureCache.stats.pendingUploads--;
+		}
+		textureCache.stats.liveTextures--;
+		textureCache.stats.residentBytes -= found->second.bytes;
+		textureCache.byKey.erase(found->second.key);
+		textureCache.byTexture.erase(found);
+		glDeleteTextures(1, &textureID);
+	}
+}
+
+TextureCacheStats GetTextureCacheStats()
+{
+	return textureCache.stats;
+}
+
+int PumpTextureUploads(double budgetSeconds)
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	int uploads = 0;
+
+	while (true) {
+		DecodeJob job;
+		{
+			std::lock_guard<std::mutex> lock(textureLoader.mutex);
+			if (textureLoader.decoded.empty()) {
+				break;
+			}
+			job = std::move(textureLoader.decoded.front());
+			textureLoader.decoded.pop_front();
+		}
+
+		// Skip textures released while decoding, their GL name may have been reused
+		std::map<GLuint, CachedTexture>::iterator found = textureCache.byTexture.find(job.texture);
+		if (found != textureCache.byTexture.end() && found->second.loadID == job.loadID) {
+			CachedTexture &entry = found->second;
+			if (job.width > 0) {
+				glBindTexture(GL_TEXTURE_2D, job.texture);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, job.width, job.height, 0, GL_RGB, GL_UNSIGNED_BYTE, job.pixels);
+
+				// Only build the mip chain when the sampler uses it
+				if (entry.mipmapped) {
+					glGenerateMipmap(GL_TEXTURE_2D);
+				}
+				entry.bytes = TextureBytes(job.width, job.height, entry.mipmapped);
+				textureCache.stats.residentBytes += entry.bytes;
+			} else {
+				// Failed images keep their placeholder
+				std::cout << "Failed to load texture " << job.path << std::endl;
+			}
+			entry.uploaded = true;
+			textureCache.stats.pendingUploads--;
+			uploads++;
+		}
+
+		// GL has its own copy now
+		stbi_image_free(job.pixels);
+
+		std::chrono::duration<double> elapsed = Clock::now() - start;
+		if (elapsed.count() >= budgetSeconds) {
+			break;
+		}
+	}
+
+	return uploads;
+}
+
+void ShutdownTextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(textureLoader.mutex);
+		textureLoader.stopping = true;
+	}
+	textureLoader.wake.notify_all();
+	for (size_t i = 0; i < textureLoader.workers.size(); ++i) {
+		textureLoader.workers[i].join();
+	}
+	textureLoader.workers.clear();
+
+	// Drop images decoded but never uploaded
+	for (size_t i = 0; i < textureLoader.decoded.size(); ++i) {
+		stbi_image_free(textureLoader.decoded[i].pixels);
+	}
+	textureLoader.decoded.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef _TEXTURE_H_
+#define _TEXTURE_H_
+
+#include <glad/gl.h>
+#include <cstddef>
+
+// Sampler parameters applied to a cached texture, part of the cache key
+struct TextureSampler {
+	GLint wrapS;
+	GLint wrapT;
+	GLint minFilter;
+	GLint magFilter;
+};
+
+// Repeat wrapping with trilinear filtering, as used by the city textures
+TextureSampler DefaultTextureSampler();
+
+// Texture cache: each image is decoded and uploaded once per (canonical path, sampler)
+// and the GL texture name is shared and reference counted between users.
+// Decoding runs on worker threads; until the image is uploaded the texture holds
+// a 1x1 placeholder, so callers can bind it immediately.
+struct TextureCacheStats {
+	int hits;				// Acquires served from the cache
+	int misses;				// Acquires that decoded and uploaded an image
+	int liveTextures;		// Textures still referenced
+	int pendingUploads;		// Textures still showing their placeholder
+	size_t residentBytes;	// Estimated GPU memory of uploaded textures, including mipmaps
+};
+
+GLuint AcquireTexture(const char *texture_file_path, const TextureSampler &sampler);
+
+GLuint AcquireTexture(const char *texture_file_path);
+
+void ReleaseTexture(GLuint textureID);
+
+TextureCacheStats GetTextureCacheStats();
+
+// Upload decoded images on the GL thread, stopping once budgetSeconds is spent
+// (at least one image is uploaded per call). Returns the number of uploads.
+int PumpTextureUploads(double budgetSeconds);
+
+// Stop and join the decode threads
+void ShutdownTextureLoader();
+
+#endif
@@ -2,11 +2,9 @@
 
 // Input
 layout(location = 0) in vec3 vertexPosition;
-layout(location = 1) in vec3 vertexColor;
-layout(location = 2) in vec2 vertexUV;
+layout(location = 1) in vec2 vertexUV;
 
 // Output data, to be interpolated for each fragment
-out vec3 color;
 out vec2 uv;
 
 // Matrix for vertex transformation
@@ -16,9 +14,6 @@ void main() {
     // Transform vertex
     gl_Position =  MVP * vec4(vertexPosition, 1);
 
-    // Pass vertex color to the fragment shader
-    color = vertexColor;
-
-    // TODO: Pass UV to the fragment shader
+    // Pass UV to the fragment shader
     uv = vertexUV;
-}
\ No newline at end of file
+}
@@ -0,0 +1,204 @@
+#include "city_generator.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+// Mix the seed and chunk coordinate into a well distributed 32-bit value
+static unsigned int HashChunk(unsigned int seed, int x, int z)
+{
+	unsigned int h = seed * 0x9E3779B9u;
+	h ^= (unsigned int)x * 0x85EBCA6Bu;
+	h = (h << 13) | (h >> 19);
+	h ^= (unsigned int)z * 0xC2B2AE35u;
+
+	// MurmurHash3 finalizer
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Small xorshift generator seeded per chunk, so layouts do not depend on generation order
+struct ChunkRandom {
+	unsigned int state;
+
+	float next() {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+void CityGenerator::initialize(unsigned int seed, int threadCount)
+{
+	this->seed = seed;
+
+	// Matches the original 200 unit grid, four lots per chunk side
+	lotSpacing = 200.0f;
+	lotsPerSide = 4;
+	loadRadius = 2;
+	unloadRadius = 3;
+	hasCameraChunk = false;
+
+	stopping = false;
+	for (int i = 0; i < std::max(threadCount, 1); ++i) {
+		workers.push_back(std::thread(&CityGenerator::workerLoop, this));
+	}
+}
+
+float CityGenerator::chunkSize() const
+{
+	return lotSpacing * lotsPerSide;
+}
+
+ChunkCoord CityGenerator::chunkAt(const glm::vec3 &position) const
+{
+	ChunkCoord coord;
+	coord.x = (int)std::floor(position.x / chunkSize());
+	coord.z = (int)std::floor(position.z / chunkSize());
+	return coord;
+}
+
+bool CityGenerator::inRange(ChunkCoord coord, int radius) const
+{
+	return std::abs(coord.x - cameraChunk.x) <= radius && std::abs(coord.z - cameraChunk.z) <= radius;
+}
+
+CityChunk CityGenerator::generateChunk(ChunkCoord coord) const
+{
+	CityChunk chunk;
+	chunk.coord = coord;
+
+	ChunkRandom random;
+	random.state = HashChunk(seed, coord.x, coord.z) | 1u;
+
+	float originX = coord.x * chunkSize();
+	float originZ = coord.z * chunkSize();
+	for (int row = 0; row < lotsPerSide; ++row) {
+		for (int col = 0; col < lotsPerSide; ++col) {
+			// Same ranges as the original hand-written grid
+			float randomOffsetX = random.next() * 50.0f;
+			float randomOffsetZ = random.next() * 50.0f;
+			float height = 100.0f + random.next() * 200.0f;
+			float buildingWidth = 30.0f + random.next() * 20.0f;
+			float buildingDepth = 30.0f + random.next() * 20.0f;
+
+			BuildingDesc building;
+			building.pos = glm::vec3(originX + col * lotSpacing + randomOffsetX, height / 2,
+				originZ + row * lotSpacing + randomOffsetZ);
+			building.scale = glm::vec3(buildingWidth, height, buildingDepth);
+			chunk.buildings.push_back(building);
+		}
+	}
+	return chunk;
+}
+
+void CityGenerator::update(const glm::vec3 &cameraPosition, std::vector<ChunkCoord> &evicted)
+{
+	ChunkCoord current = chunkAt(cameraPosition);
+	if (hasCameraChunk && current.x == cameraChunk.x && current.z == cameraChunk.z) {
+		return;
+	}
+	cameraChunk = current;
+	hasCameraChunk = true;
+
+	// Evict loaded chunks beyond the unload radius
+	for (std::set<ChunkCoord>::iterator it = loaded.begin(); it != loaded.end();) {
+		if (!inRange(*it, unloadRadius)) {
+			evicted.push_back(*it);
+			it = loaded.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	std::vector<ChunkCoord> requests;
+	for (int dz = -loadRadius; dz <= loadRadius; ++dz) {
+		for (int dx = -loadRadius; dx <= loadRadius; ++dx) {
+			ChunkCoord coord = { current.x + dx, current.z + dz };
+			if (!loaded.count(coord) && !requested.count(coord)) {
+				requests.push_back(coord);
+			}
+		}
+	}
+
+	// Nearest chunks first
+	std::sort(requests.begin(), requests.end(), [&current](const ChunkCoord &a, const ChunkCoord &b) {
+		return std::max(std::abs(a.x - current.x), std::abs(a.z - current.z)) <
+			std::max(std::abs(b.x - current.x), std::abs(b.z - current.z));
+	});
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Drop queued requests that are no longer wanted
+		for (std::deque<ChunkCoord>::iterator it = pending.begin(); it != pending.end();) {
+			if (!inRange(*it, unloadRadius)) {
+				requested.erase(*it);
+				it = pending.erase(it);
+			} else {
+				++it;
+			}
+		}
+
+		for (size_t i = 0; i < requests.size(); ++i) {
+			pending.push_back(requests[i]);
+			requested.insert(requests[i]);
+		}
+	}
+	wake.notify_all();
+}
+
+void CityGenerator::takeFinishedChunks(std::vector<CityChunk> &ready)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	while (!finished.empty()) {
+		CityChunk &chunk = finished.front();
+		requested.erase(chunk.coord);
+
+		// The camera may have moved on while the chunk was generated
+		if (inRange(chunk.coord, unloadRadius)) {
+			loaded.insert(chunk.coord);
+			ready.push_back(std::move(chunk));
+		}
+		finished.pop_front();
+	}
+}
+
+void CityGenerator::workerLoop()
+{
+	while (true) {
+		ChunkCoord coord;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !pending.empty(); });
+			if (stopping) {
+				return;
+			}
+			coord = pending.front();
+			pending.pop_front();
+		}
+
+		CityChunk chunk = generateChunk(coord);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.push_back(std::move(chunk));
+	}
+}
+
+void CityGenerator::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+	workers.clear();
+}
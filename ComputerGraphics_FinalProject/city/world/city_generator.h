@@ -0,0 +1,77 @@
+#ifndef _CITY_GENERATOR_H_
+#define _CITY_GENERATOR_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Position and size of one building, as passed to Building::initialize
+struct BuildingDesc {
+	glm::vec3 pos;
+	glm::vec3 scale;
+};
+
+// Integer coordinate of a chunk on the ground plane
+struct ChunkCoord {
+	int x;
+	int z;
+
+	bool operator<(const ChunkCoord &other) const {
+		return x < other.x || (x == other.x && z < other.z);
+	}
+};
+
+// Generated contents of one chunk
+struct CityChunk {
+	ChunkCoord coord;
+	std::vector<BuildingDesc> buildings;
+};
+
+// Splits the world into square chunks whose layout depends only on (seed, chunk coordinate),
+// so the same seed always produces the same city. Chunks around the camera are generated on
+// background threads and handed to the render thread; far chunks are evicted.
+struct CityGenerator {
+	unsigned int seed;
+	float lotSpacing;		// Distance between building lots
+	int lotsPerSide;		// Lots along each side of a chunk
+	int loadRadius;			// Chunks kept around the camera chunk (Chebyshev distance)
+	int unloadRadius;		// Chunks further than this are evicted
+
+	// Chunks queued on the workers, and chunks handed to the render thread
+	std::set<ChunkCoord> requested;
+	std::set<ChunkCoord> loaded;
+	ChunkCoord cameraChunk;
+	bool hasCameraChunk;
+
+	std::vector<std::thread> workers;
+	std::deque<ChunkCoord> pending;
+	std::deque<CityChunk> finished;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void initialize(unsigned int seed, int threadCount);
+
+	float chunkSize() const;
+	ChunkCoord chunkAt(const glm::vec3 &position) const;
+
+	// Request missing chunks around the camera and list the loaded ones that moved out of range
+	void update(const glm::vec3 &cameraPosition, std::vector<ChunkCoord> &evicted);
+
+	// Move chunks finished by the workers into ready, dropping those already out of range
+	void takeFinishedChunks(std::vector<CityChunk> &ready);
+
+	// Deterministic layout of one chunk
+	CityChunk generateChunk(ChunkCoord coord) const;
+
+	void shutdown();
+
+	void workerLoop();
+	bool inRange(ChunkCoord coord, int radius) const;
+};
+
+#endif
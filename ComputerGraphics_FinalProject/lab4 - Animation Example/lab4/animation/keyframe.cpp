@@ -0,0 +1,55 @@
+#include "keyframe.h"
+
+#include <algorithm>
+
+// Forward steps tried before falling back to a binary search
+static const int MaxCursorSteps = 4;
+
+KeyframeCursor MakeKeyframeCursor()
+{
+	KeyframeCursor cursor;
+	cursor.index = -1;
+	return cursor;
+}
+
+KeyframeLookup LocateKeyframe(const std::vector<float> &times, float time, KeyframeCursor &cursor)
+{
+	KeyframeLookup lookup;
+	int count = (int)times.size();
+	if (count < 2) {
+		lookup.index = lookup.next = 0;
+		lookup.factor = 0.0f;
+		return lookup;
+	}
+
+	int index;
+	if (time <= times[0]) {
+		index = 0;
+		lookup.factor = 0.0f;
+	} else if (time >= times[count - 1]) {
+		index = count - 2;
+		lookup.factor = 1.0f;
+	} else {
+		// times[0] < time < times[count - 1], so a segment with times[index] <= time < times[index + 1] exists
+		index = cursor.index;
+		bool found = false;
+		if (index >= 0 && index < count - 1 && times[index] <= time) {
+			for (int step = 0; step <= MaxCursorSteps; ++step) {
+				if (time < times[index + 1]) {
+					found = true;
+					break;
+				}
+				index++;
+			}
+		}
+		if (!found) {
+			index = (int)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+		}
+		lookup.factor = (time - times[index]) / (times[index + 1] - times[index]);
+	}
+
+	cursor.index = index;
+	lookup.index = index;
+	lookup.next = index + 1;
+	return lookup;
+}
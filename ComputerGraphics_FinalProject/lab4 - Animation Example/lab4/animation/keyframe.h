@@ -0,0 +1,26 @@
+#ifndef _KEYFRAME_H_
+#define _KEYFRAME_H_
+
+#include <vector>
+
+// Segment of a keyframe time array containing a playback time
+struct KeyframeLookup {
+	int index;		// Keyframe at or before the time
+	int next;		// Keyframe after it
+	float factor;	// Blend from index to next, in [0, 1]
+};
+
+// Remembers the last segment found in one time array. Playback usually moves forward
+// by a fraction of a keyframe, so the next lookup starts from here instead of searching.
+struct KeyframeCursor {
+	int index;		// -1 until the first lookup
+};
+
+KeyframeCursor MakeKeyframeCursor();
+
+// Find the segment containing time: a few forward steps from the cursor, or a binary
+// search after a seek or loop wrap. Times before the first or after the last keyframe
+// clamp to the end values.
+KeyframeLookup LocateKeyframe(const std::vector<float> &times, float time, KeyframeCursor &cursor);
+
+#endif
@@ -0,0 +1,187 @@
+#include "skeleton.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKELETON_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+Skeleton BuildSkeleton(const std::vector<std::vector<int> > &children, int root)
+{
+	Skeleton skeleton;
+	skeleton.slotOfNode.assign(children.size(), -1);
+	if (root < 0 || root >= (int)children.size()) {
+		return skeleton;
+	}
+
+	// Breadth-first, so a node is always appended after its parent
+	skeleton.nodes.push_back(root);
+	skeleton.parents.push_back(-1);
+	skeleton.depths.push_back(0);
+	skeleton.slotOfNode[root] = 0;
+	for (size_t slot = 0; slot < skeleton.nodes.size(); ++slot) {
+		const std::vector<int> &nodeChildren = children[skeleton.nodes[slot]];
+		for (size_t i = 0; i < nodeChildren.size(); ++i) {
+			int child = nodeChildren[i];
+			if (skeleton.slotOfNode[child] != -1) {
+				continue;
+			}
+			skeleton.slotOfNode[child] = (int)skeleton.nodes.size();
+			skeleton.nodes.push_back(child);
+			skeleton.parents.push_back((int)slot);
+			skeleton.depths.push_back(skeleton.depths[slot] + 1);
+		}
+	}
+	return skeleton;
+}
+
+void SkeletonPose::resize(int slots)
+{
+	count = slots;
+	size_t padded = (size_t)((slots + 3) & ~3);
+	for (int c = 0; c < 3; ++c) {
+		translation[c].assign(padded, 0.0f);
+		rotation[c].assign(padded, 0.0f);
+		scale[c].assign(padded, 1.0f);
+	}
+	rotation[3].assign(padded, 1.0f);
+}
+
+void SkeletonPose::setTranslation(int slot, const glm::vec3 &t)
+{
+	translation[0][slot] = t.x;
+	translation[1][slot] = t.y;
+	translation[2][slot] = t.z;
+}
+
+void SkeletonPose::setRotation(int slot, const glm::quat &q)
+{
+	rotation[0][slot] = q.x;
+	rotation[1][slot] = q.y;
+	rotation[2][slot] = q.z;
+	rotation[3][slot] = q.w;
+}
+
+void SkeletonPose::setScale(int slot, const glm::vec3 &s)
+{
+	scale[0][slot] = s.x;
+	scale[1][slot] = s.y;
+	scale[2][slot] = s.z;
+}
+
+#ifdef SKELETON_USE_SSE
+
+// Builds four matrices per iteration: each lane is one slot, and the rotation terms
+// follow glm::mat3_cast so the result matches the scalar path
+void ComposeLocalTransforms(const SkeletonPose &pose, int count, glm::mat4 *localTransforms)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (int base = 0; base < count; base += 4) {
+		__m128 x = _mm_loadu_ps(&pose.rotation[0][base]);
+		__m128 y = _mm_loadu_ps(&pose.rotation[1][base]);
+		__m128 z = _mm_loadu_ps(&pose.rotation[2][base]);
+		__m128 w = _mm_loadu_ps(&pose.rotation[3][base]);
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xz = _mm_mul_ps(x, z), xy = _mm_mul_ps(x, y), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		__m128 sx = _mm_loadu_ps(&pose.scale[0][base]);
+		__m128 sy = _mm_loadu_ps(&pose.scale[1][base]);
+		__m128 sz = _mm_loadu_ps(&pose.scale[2][base]);
+
+		// Rotation columns scaled per axis, one register per matrix element
+		__m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		__m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		__m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		__m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		__m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		__m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		__m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		__m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		__m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+		__m128 c3x = _mm_loadu_ps(&pose.translation[0][base]);
+		__m128 c3y = _mm_loadu_ps(&pose.translation[1][base]);
+		__m128 c3z = _mm_loadu_ps(&pose.translation[2][base]);
+		__m128 c0w = zero, c1w = zero, c2w = zero, c3w = one;
+
+		// Turn element-per-register into column-per-register
+		_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+		_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+		_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+		_MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+		__m128 columns[4][4] = {
+			{ c0x, c1x, c2x, c3x },
+			{ c0y, c1y, c2y, c3y },
+			{ c0z, c1z, c2z, c3z },
+			{ c0w, c1w, c2w, c3w }
+		};
+
+		int lanes = count - base < 4 ? count - base : 4;
+		for (int lane = 0; lane < lanes; ++lane) {
+			float *out = &localTransforms[base + lane][0][0];
+			for (int c = 0; c < 4; ++c) {
+				_mm_storeu_ps(out + 4 * c, columns[lane][c]);
+			}
+		}
+	}
+}
+
+void ConcatenateHierarchy(const Skeleton &skeleton, const glm::mat4 *localTransforms,
+	const glm::mat4 &rootTransform, glm::mat4 *globalTransforms)
+{
+	for (size_t slot = 0; slot < skeleton.parents.size(); ++slot) {
+		int parent = skeleton.parents[slot];
+		const float *a = parent < 0 ? &rootTransform[0][0] : &globalTransforms[parent][0][0];
+		const float *b = &localTransforms[slot][0][0];
+		float *out = &globalTransforms[slot][0][0];
+
+		__m128 a0 = _mm_loadu_ps(a);
+		__m128 a1 = _mm_loadu_ps(a + 4);
+		__m128 a2 = _mm_loadu_ps(a + 8);
+		__m128 a3 = _mm_loadu_ps(a + 12);
+
+		// Column c of the product is the parent columns weighted by column c of the local matrix
+		for (int c = 0; c < 4; ++c) {
+			const float *column = b + 4 * c;
+			__m128 sum = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+			_mm_storeu_ps(out + 4 * c, sum);
+		}
+	}
+}
+
+#else
+
+void ComposeLocalTransforms(const SkeletonPose &pose, int count, glm::mat4 *localTransforms)
+{
+	for (int slot = 0; slot < count; ++slot) {
+		float x = pose.rotation[0][slot], y = pose.rotation[1][slot], z = pose.rotation[2][slot], w = pose.rotation[3][slot];
+		float xx = x * x, yy = y * y, zz = z * z;
+		float xz = x * z, xy = x * y, yz = y * z;
+		float wx = w * x, wy = w * y, wz = w * z;
+		float sx = pose.scale[0][slot], sy = pose.scale[1][slot], sz = pose.scale[2][slot];
+
+		glm::mat4 &m = localTransforms[slot];
+		m[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * sx, 2.0f * (xy + wz) * sx, 2.0f * (xz - wy) * sx, 0.0f);
+		m[1] = glm::vec4(2.0f * (xy - wz) * sy, (1.0f - 2.0f * (xx + zz)) * sy, 2.0f * (yz + wx) * sy, 0.0f);
+		m[2] = glm::vec4(2.0f * (xz + wy) * sz, 2.0f * (yz - wx) * sz, (1.0f - 2.0f * (xx + yy)) * sz, 0.0f);
+		m[3] = glm::vec4(pose.translation[0][slot], pose.translation[1][slot], pose.translation[2][slot], 1.0f);
+	}
+}
+
+void ConcatenateHierarchy(const Skeleton &skeleton, const glm::mat4 *localTransforms,
+	const glm::mat4 &rootTransform, glm::mat4 *globalTransforms)
+{
+	for (size_t slot = 0; slot < skeleton.parents.size(); ++slot) {
+		int parent = skeleton.parents[slot];
+		const glm::mat4 &parentTransform = parent < 0 ? rootTransform : globalTransforms[parent];
+		globalTransforms[slot] = parentTransform * localTransforms[slot];
+	}
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _SKELETON_H_
+#define _SKELETON_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// Nodes of one hierarchy in a flat array, every parent stored before its children,
+// so global transforms are a single linear pass with no recursion. Slots are in
+// breadth-first order, so depths never decrease along the array.
+struct Skeleton {
+	std::vector<int> nodes;			// glTF node in each slot
+	std::vector<int> parents;		// Parent slot, -1 for the root
+	std::vector<int> depths;		// Joints between the slot and the root
+	std::vector<int> slotOfNode;	// Slot of each glTF node, -1 outside the hierarchy
+};
+
+// Flatten the hierarchy below root; children[i] lists the child nodes of node i
+Skeleton BuildSkeleton(const std::vector<std::vector<int> > &children, int root);
+
+// Local TRS of every slot in structure-of-arrays lanes, padded to a multiple of 4
+// so the SIMD kernels can always process whole groups.
+struct SkeletonPose {
+	int count;
+	std::vector<float> translation[3];
+	std::vector<float> rotation[4];		// x, y, z, w
+	std::vector<float> scale[3];
+
+	// Size the lanes for count slots, all at the identity transform
+	void resize(int count);
+
+	void setTranslation(int slot, const glm::vec3 &t);
+	void setRotation(int slot, const glm::quat &q);
+	void setScale(int slot, const glm::vec3 &s);
+};
+
+// localTransforms[slot] = T * R * S for the first count slots, four slots per SSE iteration.
+// Slots are parents first, so a smaller count drops the deepest joints.
+void ComposeLocalTransforms(const SkeletonPose &pose, int count, glm::mat4 *localTransforms);
+
+// globalTransforms[slot] = globalTransforms[parent] * localTransforms[slot], rootTransform above the root
+void ConcatenateHierarchy(const Skeleton &skeleton, const glm::mat4 *localTransforms,
+	const glm::mat4 &rootTransform, glm::mat4 *globalTransforms);
+
+#endif
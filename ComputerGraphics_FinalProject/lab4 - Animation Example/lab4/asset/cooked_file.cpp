@@ -0,0 +1,193 @@
+#include "cooked_file.h"
+
+#include <cstdio>
+#include <sys/stat.h>
+
+// Size and modification time of a source, the cheap check before hashing its contents
+struct SourceStamp {
+	uint64_t size;
+	int64_t modifiedTime;
+};
+
+static bool GetSourceStamp(const std::string &path, SourceStamp &stamp)
+{
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) {
+		return false;
+	}
+	stamp.size = (uint64_t)status.st_size;
+	stamp.modifiedTime = (int64_t)status.st_mtime;
+	return true;
+}
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool HashCookedSources(const std::vector<std::string> &sources, uint64_t &hash)
+{
+	hash = HashBytes(NULL, 0);
+	for (size_t i = 0; i < sources.size(); ++i) {
+		MappedFile file = MapFile(sources[i]);
+		if (file.data == NULL) {
+			return false;
+		}
+		uint64_t size = file.size;
+		hash = HashBytes(&size, sizeof(size), hash);
+		hash = HashBytes(file.data, file.size, hash);
+		UnmapFile(file);
+	}
+	return true;
+}
+
+void WriteCookedBytes(CookedWriter &writer, const void *data, size_t size)
+{
+	writer.file.write((const char *)data, size);
+}
+
+void WriteCookedCount(CookedWriter &writer, size_t count)
+{
+	WriteCookedValue(writer, (uint64_t)count);
+}
+
+void WriteCookedString(CookedWriter &writer, const std::string &value)
+{
+	WriteCookedValue(writer, (uint64_t)value.size());
+	WriteCookedBytes(writer, value.data(), value.size());
+}
+
+bool BeginCookedFile(CookedWriter &writer, const std::string &path, uint32_t magic, uint32_t version,
+	const std::vector<std::string> &sources)
+{
+	CookedHeader header;
+	header.magic = magic;
+	header.version = version;
+	std::vector<SourceStamp> stamps(sources.size());
+	for (size_t i = 0; i < sources.size(); ++i) {
+		if (!GetSourceStamp(sources[i], stamps[i])) {
+			return false;
+		}
+	}
+	if (!HashCookedSources(sources, header.sourceHash)) {
+		return false;
+	}
+
+	writer.path = path;
+	writer.file.open((path + ".tmp").c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!writer.file.is_open()) {
+		return false;
+	}
+	WriteCookedValue(writer, header);
+	WriteCookedCount(writer, sources.size());
+	for (size_t i = 0; i < sources.size(); ++i) {
+		WriteCookedString(writer, sources[i]);
+		WriteCookedValue(writer, stamps[i]);
+	}
+	return true;
+}
+
+bool FinishCookedFile(CookedWriter &writer)
+{
+	std::string temporaryPath = writer.path + ".tmp";
+	writer.file.close();
+	if (writer.file.fail()) {
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+	std::remove(writer.path.c_str());
+	return std::rename(temporaryPath.c_str(), writer.path.c_str()) == 0;
+}
+
+bool ReadCookedBytes(CookedReader &reader, void *data, size_t size)
+{
+	if (reader.failed || size > reader.file.size - reader.offset) {
+		reader.failed = true;
+		return false;
+	}
+	if (size > 0) {
+		memcpy(data, reader.file.data + reader.offset, size);
+	}
+	reader.offset += size;
+	return true;
+}
+
+bool SkipCookedArray(CookedReader &reader, size_t elementSize, size_t &offset, size_t &count)
+{
+	uint64_t elements = ReadCookedValue<uint64_t>(reader);
+	if (reader.failed || elements > (reader.file.size - reader.offset) / elementSize) {
+		reader.failed = true;
+		return false;
+	}
+	offset = reader.offset;
+	count = (size_t)elements;
+	reader.offset += count * elementSize;
+	return true;
+}
+
+size_t ReadCookedCount(CookedReader &reader)
+{
+	uint64_t count = ReadCookedValue<uint64_t>(reader);
+	if (reader.failed || count > reader.file.size - reader.offset) {
+		reader.failed = true;
+		return 0;
+	}
+	return (size_t)count;
+}
+
+std::string ReadCookedString(CookedReader &reader)
+{
+	uint64_t size = ReadCookedValue<uint64_t>(reader);
+	if (reader.failed || size > reader.file.size - reader.offset) {
+		reader.failed = true;
+		return std::string();
+	}
+	std::string value((const char *)reader.file.data + reader.offset, (size_t)size);
+	reader.offset += (size_t)size;
+	return value;
+}
+
+bool OpenCookedFile(const std::string &path, uint32_t magic, uint32_t version, CookedReader &reader)
+{
+	reader.offset = 0;
+	reader.failed = false;
+	reader.file = MapFile(path);
+	if (reader.file.data == NULL) {
+		return false;
+	}
+
+	CookedHeader header = ReadCookedValue<CookedHeader>(reader);
+	if (reader.failed || header.magic != magic || header.version != version) {
+		return false;
+	}
+
+	size_t sourceCount = ReadCookedCount(reader);
+	std::vector<std::string> sources;
+	bool stampsMatch = true;
+	for (size_t i = 0; i < sourceCount && !reader.failed; ++i) {
+		sources.push_back(ReadCookedString(reader));
+		SourceStamp cookedStamp = ReadCookedValue<SourceStamp>(reader);
+		SourceStamp stamp;
+		if (!GetSourceStamp(sources.back(), stamp)) {
+			return false;
+		}
+		stampsMatch = stampsMatch && stamp.size == cookedStamp.size && stamp.modifiedTime == cookedStamp.modifiedTime;
+	}
+	if (reader.failed) {
+		return false;
+	}
+
+	// A touched but unchanged source still hashes the same
+	uint64_t sourceHash;
+	return stampsMatch || (HashCookedSources(sources, sourceHash) && sourceHash == header.sourceHash);
+}
+
+void CloseCookedFile(CookedReader &reader)
+{
+	UnmapFile(reader.file);
+}
@@ -0,0 +1,118 @@
+#ifndef _COOKED_FILE_H_
+#define _COOKED_FILE_H_
+
+#include <asset/mapped_file.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary container for data extracted from source assets in its final in-memory layout.
+// A file starts with a CookedHeader, then the source files it was cooked from with their
+// sizes and modification times, then the payload written with the WriteCooked* functions.
+// Values and arrays are raw bytes, so a file is only read back by the build that wrote it:
+// bump the version when the payload layout changes.
+
+struct CookedHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;	// HashCookedSources of the listed sources when cooked
+};
+
+// FNV-1a, continuing from hash
+uint64_t HashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+// Hash the contents of every source in order; false if one cannot be read
+bool HashCookedSources(const std::vector<std::string> &sources, uint64_t &hash);
+
+// Streams the payload to a temporary file, so cooking holds no second copy of it
+struct CookedWriter {
+	std::string path;
+	std::ofstream file;
+};
+
+void WriteCookedBytes(CookedWriter &writer, const void *data, size_t size);
+
+template <typename T>
+void WriteCookedValue(CookedWriter &writer, const T &value)
+{
+	WriteCookedBytes(writer, &value, sizeof(T));
+}
+
+// Element count followed by the elements
+template <typename T>
+void WriteCookedArray(CookedWriter &writer, const std::vector<T> &values)
+{
+	WriteCookedValue(writer, (uint64_t)values.size());
+	WriteCookedBytes(writer, values.data(), values.size() * sizeof(T));
+}
+
+// Number of records that follow, each written by the caller
+void WriteCookedCount(CookedWriter &writer, size_t count);
+
+void WriteCookedString(CookedWriter &writer, const std::string &value);
+
+// Start the file at path with the header and source list; the hash and stamps are taken
+// from the sources as they are now. Call FinishCookedFile only if this succeeds.
+bool BeginCookedFile(CookedWriter &writer, const std::string &path, uint32_t magic, uint32_t version,
+	const std::vector<std::string> &sources);
+
+// Rename the finished temporary file over path, so readers never see a partial file
+bool FinishCookedFile(CookedWriter &writer);
+
+// Reads a mapped file. Reads stop at the end of the data: once one fails, failed stays
+// set and every later read returns value-initialized data, so a payload can be read
+// straight through and checked once.
+struct CookedReader {
+	MappedFile file;
+	size_t offset;
+	bool failed;
+};
+
+bool ReadCookedBytes(CookedReader &reader, void *data, size_t size);
+
+template <typename T>
+T ReadCookedValue(CookedReader &reader)
+{
+	T value = T();
+	ReadCookedBytes(reader, &value, sizeof(T));
+	return value;
+}
+
+template <typename T>
+bool ReadCookedArray(CookedReader &reader, std::vector<T> &values)
+{
+	uint64_t count = ReadCookedValue<uint64_t>(reader);
+	if (reader.failed || count > (reader.file.size - reader.offset) / sizeof(T)) {
+		reader.failed = true;
+		values.clear();
+		return false;
+	}
+	values.resize((size_t)count);
+	return ReadCookedBytes(reader, values.data(), values.size() * sizeof(T));
+}
+
+// Skip an array written by WriteCookedArray, leaving its elements in the mapping from
+// offset. Lets a caller keep reader.file instead of copying a large array out of it.
+bool SkipCookedArray(CookedReader &reader, size_t elementSize, size_t &offset, size_t &count);
+
+// Count written by WriteCookedCount; fails once it exceeds the bytes left, so a damaged
+// count cannot size a huge allocation
+size_t ReadCookedCount(CookedReader &reader);
+
+std::string ReadCookedString(CookedReader &reader);
+
+// Map the file and check its header and sources. False if the file is missing, has
+// another magic or version, or any source changed since it was cooked; the reader is
+// then positioned at the payload. Sources are only hashed again when one's size or
+// modification time differs from the file, so a current file costs one stat per source.
+// Close the reader whether or not this succeeds.
+bool OpenCookedFile(const std::string &path, uint32_t magic, uint32_t version, CookedReader &reader);
+
+// Unmap the file unless the caller took reader.file
+void CloseCookedFile(CookedReader &reader);
+
+#endif
@@ -0,0 +1,29 @@
+#include "gltf_file.h"
+
+#include <asset/mapped_file.h>
+#include <tiny_gltf.h>
+
+#include <cstring>
+
+// First four bytes of every GLB file: "glTF"
+static const unsigned char GLBMagic[4] = { 'g', 'l', 'T', 'F' };
+
+bool LoadGLTFFile(tinygltf::Model &model, const std::string &filename, std::string &err, std::string &warn)
+{
+	MappedFile file = MapFile(filename);
+	if (file.data == NULL) {
+		err = "Unable to read file: " + filename;
+		return false;
+	}
+
+	std::string directory = filename.substr(0, filename.find_last_of("/\\") + 1);
+	tinygltf::TinyGLTF loader;
+	bool loaded;
+	if (file.size >= sizeof(GLBMagic) && memcmp(file.data, GLBMagic, sizeof(GLBMagic)) == 0) {
+		loaded = loader.LoadBinaryFromMemory(&model, &err, &warn, file.data, (unsigned int)file.size, directory);
+	} else {
+		loaded = loader.LoadASCIIFromString(&model, &err, &warn, (const char *)file.data, (unsigned int)file.size, directory);
+	}
+	UnmapFile(file);
+	return loaded;
+}
@@ -0,0 +1,17 @@
+#ifndef _GLTF_FILE_H_
+#define _GLTF_FILE_H_
+
+#include <string>
+
+// Including tiny_gltf.h here would expand its implementation a second time in the file
+// that defines TINYGLTF_IMPLEMENTATION
+namespace tinygltf {
+class Model;
+}
+
+// Load a .gltf (JSON) or .glb (binary) file, telling them apart by the GLB magic number
+// rather than the extension. The file is mapped and parsed in place; external buffers
+// and images are resolved next to it.
+bool LoadGLTFFile(tinygltf::Model &model, const std::string &filename, std::string &err, std::string &warn);
+
+#endif
@@ -0,0 +1,80 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile MapFile(const std::string &path)
+{
+	MappedFile file = { NULL, 0 };
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return file;
+	}
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+		// The view keeps the mapping alive once both handles are closed
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL) {
+			file.data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			file.size = file.data != NULL ? (size_t)size.QuadPart : 0;
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(handle);
+	return file;
+}
+
+void UnmapFile(MappedFile &file)
+{
+	if (file.data != NULL) {
+		UnmapViewOfFile(file.data);
+	}
+	file.data = NULL;
+	file.size = 0;
+}
+
+#else
+
+MappedFile MapFile(const std::string &path)
+{
+	MappedFile file = { NULL, 0 };
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		return file;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	struct stat status;
+	if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+		void *data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (data != MAP_FAILED) {
+			file.data = (const unsigned char *)data;
+			file.size = (size_t)status.st_size;
+		}
+	}
+	close(descriptor);
+	return file;
+}
+
+void UnmapFile(MappedFile &file)
+{
+	if (file.data != NULL) {
+		munmap((void *)file.data, file.size);
+	}
+	file.data = NULL;
+	file.size = 0;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file through the virtual memory system. Pages are read on
+// first touch and belong to the page cache, so mapping a file costs no heap memory and
+// no copy until the bytes are used.
+struct MappedFile {
+	const unsigned char *data;	// NULL if the file could not be mapped
+	size_t size;
+};
+
+// Empty files cannot be mapped and fail like missing ones
+MappedFile MapFile(const std::string &path);
+
+void UnmapFile(MappedFile &file);
+
+#endif
@@ -0,0 +1,359 @@
+#include "mesh_optimizer.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const uint32_t NoVertex = ~0u;
+
+// Cache modelled by the triangle order, larger than the reported one as in Forsyth's paper
+static const int ForsythCacheSize = 32;
+
+static float ForsythVertexScore(int cachePosition, int activeTriangles)
+{
+	if (activeTriangles == 0) {
+		return -1.0f;
+	}
+
+	// The last triangle's vertices score alike, so its neighbours are not favoured by order
+	float score = 0.0f;
+	if (cachePosition >= 0 && cachePosition < 3) {
+		score = 0.75f;
+	} else if (cachePosition >= 3) {
+		score = powf(1.0f - (float)(cachePosition - 3) / (ForsythCacheSize - 3), 1.5f);
+	}
+
+	// Vertices with few triangles left are finished first, so they stop holding cache entries
+	return score + 2.0f / sqrtf((float)activeTriangles);
+}
+
+static uint32_t HashVertex(const unsigned char *vertex, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= vertex[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void UnpackIndices(const unsigned char *data, size_t count, size_t indexSize, std::vector<uint32_t> &indices)
+{
+	indices.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		if (indexSize == 1) {
+			indices[i] = data[i];
+		} else if (indexSize == 2) {
+			uint16_t index;
+			memcpy(&index, data + i * 2, 2);
+			indices[i] = index;
+		} else {
+			memcpy(&indices[i], data + i * 4, 4);
+		}
+	}
+}
+
+size_t CountVertexCacheMisses(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize)
+{
+	// A vertex is cached while fewer than cacheSize others were inserted after it
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t insertions = cacheSize + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < indices.size(); ++i) {
+		uint32_t vertex = indices[i];
+		if (insertions - insertedAt[vertex] > (size_t)cacheSize) {
+			insertedAt[vertex] = insertions++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+size_t GenerateVertexRemap(const unsigned char *vertices, size_t vertexCount, size_t vertexSize,
+	std::vector<uint32_t> &remap)
+{
+	// Open addressing table of the first vertex seen with each value, at most half full
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2) {
+		tableSize *= 2;
+	}
+	std::vector<uint32_t> table(tableSize, NoVertex);
+
+	remap.assign(vertexCount, NoVertex);
+	size_t uniqueCount = 0;
+	for (size_t v = 0; v < vertexCount; ++v) {
+		const unsigned char *vertex = vertices + v * vertexSize;
+		size_t slot = HashVertex(vertex, vertexSize) & (tableSize - 1);
+		while (table[slot] != NoVertex && memcmp(vertices + table[slot] * vertexSize, vertex, vertexSize) != 0) {
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == NoVertex) {
+			table[slot] = (uint32_t)v;
+			remap[v] = (uint32_t)uniqueCount++;
+		} else {
+			remap[v] = remap[table[slot]];
+		}
+	}
+	return uniqueCount;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+
+	// Triangles of each vertex, those still to be emitted first
+	std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		firstTriangle[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		firstTriangle[v + 1] += firstTriangle[v];
+	}
+	std::vector<int> activeTriangles(vertexCount, 0);
+	std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		uint32_t vertex = indices[i];
+		vertexTriangles[firstTriangle[vertex] + activeTriangles[vertex]++] = (uint32_t)(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertexScore[v] = ForsythVertexScore(-1, activeTriangles[v]);
+	}
+	std::vector<bool> emitted(triangleCount, false);
+
+	// Most recently used first; holds up to three extra entries while being updated
+	std::vector<uint32_t> cache, nextCache;
+	std::vector<uint32_t> optimized;
+	optimized.reserve(triangleCount * 3);
+	size_t nextUnemitted = 0;
+	int bestTriangle = -1;
+	while (optimized.size() < triangleCount * 3) {
+		// Nothing in the cache has triangles left: continue with the next one in source order
+		if (bestTriangle < 0) {
+			while (emitted[nextUnemitted]) {
+				nextUnemitted++;
+			}
+			bestTriangle = (int)nextUnemitted;
+		}
+
+		const uint32_t *triangle = &indices[bestTriangle * 3];
+		emitted[bestTriangle] = true;
+		nextCache.assign(triangle, triangle + 3);
+		for (int k = 0; k < 3; ++k) {
+			uint32_t vertex = triangle[k];
+			optimized.push_back(vertex);
+
+			// Swap the triangle out of the vertex's active ones
+			uint32_t *triangles = &vertexTriangles[firstTriangle[vertex]];
+			int last = --activeTriangles[vertex];
+			for (int t = 0; t <= last; ++t) {
+				if (triangles[t] == (uint32_t)bestTriangle) {
+					std::swap(triangles[t], triangles[last]);
+					break;
+				}
+			}
+		}
+		for (size_t i = 0; i < cache.size(); ++i) {
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2]) {
+				nextCache.push_back(cache[i]);
+			}
+		}
+
+		// Rescore every vertex that moved, including those pushed out of the cache
+		for (size_t i = 0; i < nextCache.size(); ++i) {
+			uint32_t vertex = nextCache[i];
+			cachePosition[vertex] = i < (size_t)ForsythCacheSize ? (int)i : -1;
+			vertexScore[vertex] = ForsythVertexScore(cachePosition[vertex], activeTriangles[vertex]);
+		}
+		if (nextCache.size() > (size_t)ForsythCacheSize) {
+			nextCache.resize(ForsythCacheSize);
+		}
+		cache.swap(nextCache);
+
+		// Only triangles of cached vertices changed score enough to be the next best
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < cache.size(); ++i) {
+			uint32_t vertex = cache[i];
+			const uint32_t *triangles = &vertexTriangles[firstTriangle[vertex]];
+			for (int t = 0; t < activeTriangles[vertex]; ++t) {
+				const uint32_t *candidate = &indices[triangles[t] * 3];
+				float score = vertexScore[candidate[0]] + vertexScore[candidate[1]] + vertexScore[candidate[2]];
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = (int)triangles[t];
+				}
+			}
+		}
+	}
+	optimized.insert(optimized.end(), indices.begin() + triangleCount * 3, indices.end());
+	indices.swap(optimized);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t> &indices, const unsigned char *positions, size_t stride,
+	size_t vertexCount, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// A cluster starts wherever a triangle misses all three vertices in the cache
+	std::vector<size_t> clusterStarts;
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t insertions = VertexCacheSize + 1;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		int misses = 0;
+		for (int k = 0; k < 3; ++k) {
+			uint32_t vertex = indices[t * 3 + k];
+			if (insertions - insertedAt[vertex] > (size_t)VertexCacheSize) {
+				insertedAt[vertex] = insertions++;
+				misses++;
+			}
+		}
+		if (misses == 3) {
+			clusterStarts.push_back(t);
+		}
+	}
+	if (clusterStarts.size() < 2) {
+		return;
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// Area weighted centre and summed normal of each cluster and of the whole mesh
+	size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<glm::vec3> clusterCentres(clusterCount), clusterNormals(clusterCount);
+	glm::vec3 meshCentre(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; ++c) {
+		glm::vec3 centre(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+			glm::vec3 corners[3];
+			for (int k = 0; k < 3; ++k) {
+				memcpy(&corners[k], positions + indices[t * 3 + k] * stride, sizeof(glm::vec3));
+			}
+			glm::vec3 cross = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+			float triangleArea = glm::length(cross);
+			centre += (corners[0] + corners[1] + corners[2]) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+		meshCentre += centre;
+		meshArea += area;
+		clusterCentres[c] = area > 0.0f ? centre / area : centre;
+		clusterNormals[c] = normal;
+	}
+	if (meshArea > 0.0f) {
+		meshCentre /= meshArea;
+	}
+
+	std::vector<float> facing(clusterCount);
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		float normalLength = glm::length(clusterNormals[c]);
+		facing[c] = normalLength > 0.0f ? glm::dot(clusterCentres[c] - meshCentre, clusterNormals[c]) / normalLength : 0.0f;
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&facing](size_t a, size_t b) { return facing[a] > facing[b]; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for (size_t c : order) {
+		sorted.insert(sorted.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+	sorted.insert(sorted.end(), indices.begin() + triangleCount * 3, indices.end());
+	if (CountVertexCacheMisses(sorted, vertexCount, VertexCacheSize) <=
+		threshold * CountVertexCacheMisses(indices, vertexCount, VertexCacheSize)) {
+		indices.swap(sorted);
+	}
+}
+
+size_t GenerateVertexFetchRemap(const std::vector<uint32_t> &indices, size_t vertexCount, std::vector<uint32_t> &remap)
+{
+	remap.assign(vertexCount, NoVertex);
+	size_t usedCount = 0;
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (remap[indices[i]] == NoVertex) {
+			remap[indices[i]] = (uint32_t)usedCount++;
+		}
+	}
+	return usedCount;
+}
+
+void OptimizeMesh(const std::vector<uint32_t> &sourceIndices, const MeshStream *streams, size_t streamCount,
+	int positionStream, OptimizedMesh &mesh)
+{
+	size_t sourceVertexCount = 0;
+	for (size_t i = 0; i < sourceIndices.size(); ++i) {
+		sourceVertexCount = std::max(sourceVertexCount, (size_t)sourceIndices[i] + 1);
+	}
+
+	// Interleave the streams with zeroed padding, so identical vertices compare equal
+	size_t vertexSize = 0;
+	mesh.streamOffsets.resize(streamCount);
+	for (size_t s = 0; s < streamCount; ++s) {
+		mesh.streamOffsets[s] = vertexSize;
+		vertexSize += (streams[s].size + 3) & ~(size_t)3;
+	}
+	std::vector<unsigned char> interleaved(sourceVertexCount * vertexSize, 0);
+	for (size_t v = 0; v < sourceVertexCount; ++v) {
+		for (size_t s = 0; s < streamCount; ++s) {
+			memcpy(&interleaved[v * vertexSize + mesh.streamOffsets[s]], streams[s].data + v * streams[s].stride,
+				streams[s].size);
+		}
+	}
+
+	// Merge identical vertices
+	std::vector<uint32_t> remap;
+	size_t uniqueCount = GenerateVertexRemap(interleaved.data(), sourceVertexCount, vertexSize, remap);
+	std::vector<uint32_t> indices(sourceIndices.size());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = remap[sourceIndices[i]];
+	}
+	std::vector<unsigned char> uniqueVertices(uniqueCount * vertexSize);
+	for (size_t v = 0; v < sourceVertexCount; ++v) {
+		memcpy(&uniqueVertices[remap[v] * vertexSize], &interleaved[v * vertexSize], vertexSize);
+	}
+	std::vector<unsigned char>().swap(interleaved);
+
+	OptimizeVertexCache(indices, uniqueCount);
+	if (positionStream >= 0) {
+		OptimizeOverdraw(indices, uniqueVertices.data() + mesh.streamOffsets[positionStream], vertexSize,
+			uniqueCount, OverdrawThreshold);
+	}
+
+	// Number the vertices in the order the triangles first use them
+	size_t usedCount = GenerateVertexFetchRemap(indices, uniqueCount, remap);
+	mesh.vertices.resize(usedCount * vertexSize);
+	for (size_t v = 0; v < uniqueCount; ++v) {
+		if (remap[v] != NoVertex) {
+			memcpy(&mesh.vertices[remap[v] * vertexSize], &uniqueVertices[v * vertexSize], vertexSize);
+		}
+	}
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = remap[indices[i]];
+	}
+
+	mesh.vertexSize = vertexSize;
+	mesh.vertexCount = usedCount;
+	mesh.sourceVertexCount = sourceVertexCount;
+	mesh.sourceCacheMisses = CountVertexCacheMisses(sourceIndices, sourceVertexCount, VertexCacheSize);
+	mesh.cacheMisses = CountVertexCacheMisses(indices, usedCount, VertexCacheSize);
+
+	// Without primitive restart every 16-bit value is a valid index
+	mesh.indexSize = usedCount <= 65536 ? 2 : 4;
+	mesh.indexCount = indices.size();
+	mesh.indices.resize(indices.size() * mesh.indexSize);
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (mesh.indexSize == 2) {
+			uint16_t index = (uint16_t)indices[i];
+			memcpy(&mesh.indices[i * 2], &index, 2);
+		} else {
+			memcpy(&mesh.indices[i * 4], &indices[i], 4);
+		}
+	}
+}
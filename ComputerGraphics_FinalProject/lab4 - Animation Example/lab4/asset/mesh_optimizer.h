@@ -0,0 +1,69 @@
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Import stage for indexed triangle lists: merges identical vertices, orders triangles for
+// the post-transform vertex cache and then for overdraw, numbers vertices in first-use
+// order so fetches walk memory forwards, and narrows indices to 16 bits where they fit.
+
+// Entries of the FIFO cache simulated for the reported miss counts
+static const int VertexCacheSize = 16;
+
+// Cache misses the overdraw order may add, as a factor of the cache-optimized order's
+static const float OverdrawThreshold = 1.05f;
+
+// One vertex attribute of a source mesh: size bytes per vertex, stride bytes apart
+struct MeshStream {
+	const unsigned char *data;
+	size_t size;
+	size_t stride;
+};
+
+// Vertices with every stream interleaved, each stream at a 4-byte aligned offset
+struct OptimizedMesh {
+	std::vector<unsigned char> vertices;
+	std::vector<size_t> streamOffsets;	// Of each stream within a vertex
+	size_t vertexSize;
+	size_t vertexCount;
+	std::vector<unsigned char> indices;
+	size_t indexSize;					// 2 or 4 bytes
+	size_t indexCount;
+	size_t sourceVertexCount;			// Vertices the source indices reach
+	size_t sourceCacheMisses;			// Simulated misses of the source triangle order
+	size_t cacheMisses;					// Simulated misses of the optimized order
+};
+
+// Widen count indices of indexSize bytes (1, 2 or 4)
+void UnpackIndices(const unsigned char *data, size_t count, size_t indexSize, std::vector<uint32_t> &indices);
+
+// Vertices a FIFO post-transform cache of cacheSize entries transforms for indices.
+// Divided by the triangle count this is the average cache miss ratio (ACMR).
+size_t CountVertexCacheMisses(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize);
+
+// remap[v] is the new index of vertex v, shared by every vertex with the same vertexSize
+// bytes; returns the number of distinct vertices
+size_t GenerateVertexRemap(const unsigned char *vertices, size_t vertexCount, size_t vertexSize,
+	std::vector<uint32_t> &remap);
+
+// Reorder triangles with Forsyth's linear-speed vertex cache optimization
+void OptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+
+// Split a cache-optimized order where the cache starts over and draw the clusters facing
+// away from the mesh centre first, so they occlude the inner ones. The order is kept if it
+// would cost more than threshold times the cache misses. positions are 3 floats each.
+void OptimizeOverdraw(std::vector<uint32_t> &indices, const unsigned char *positions, size_t stride,
+	size_t vertexCount, float threshold);
+
+// remap[v] is the new index of vertex v in order of first use, or ~0 if no index uses it;
+// returns the number of vertices used
+size_t GenerateVertexFetchRemap(const std::vector<uint32_t> &indices, size_t vertexCount, std::vector<uint32_t> &remap);
+
+// Run every stage over a triangle list whose streams hold at least max index + 1 vertices.
+// positionStream is the stream of 3-float positions for the overdraw order, or -1 to skip it.
+void OptimizeMesh(const std::vector<uint32_t> &indices, const MeshStream *streams, size_t streamCount,
+	int positionStream, OptimizedMesh &mesh);
+
+#endif
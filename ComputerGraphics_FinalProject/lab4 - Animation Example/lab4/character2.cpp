@@ -4,6 +4,8 @@
 #include <vector>
 #include <sstream>
 #include <iomanip>
+#include <map>
+#include <algorithm>
 
 // GLM for matrix and vector math
 #include <glm/glm.hpp>
@@ -20,6 +22,18 @@
 #include <glad/gl.h> // Use GLAD or GLEW depending on your setup
 #include <GLFW/glfw3.h>
 
+// Keyframe lookup
+#include <animation/keyframe.h>
+
+// glTF or GLB loading
+#include <asset/gltf_file.h>
+
+// Vertex cache, overdraw and vertex fetch ordering at load time
+#include <asset/mesh_optimizer.h>
+
+// Background jobs for loading the model off the GL thread
+#include <jobs/job_system.h>
+
 // Macros
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
@@ -62,11 +76,43 @@ void processInput(GLFWwindow* window);
 size_t GetComponentSizeInBytes(int componentType);
 size_t GetNumComponentsInType(int type);
 
+// Mesh import stage: --raw-meshes uploads indices and attributes as authored
+bool optimizeMeshes = true;
+
+// Totals over the primitives uploaded through the mesh import stage
+struct MeshOptimizationTotals {
+    size_t triangles = 0;
+    size_t sourceCacheMisses = 0;
+    size_t cacheMisses = 0;
+    size_t sourceBytes = 0;     // Indices and drawn attributes as authored
+    size_t bytes = 0;
+};
+
+// Indexed triangle primitive run through OptimizeMesh, ready for uploadOptimizedPrimitive
+struct PreparedPrimitive {
+    bool optimized = false;
+    OptimizedMesh mesh;
+    std::vector<const tinygltf::Accessor*> streamAccessors;
+    std::vector<int> streamLocations;
+};
+
+// The model as a background job hands it to the GL thread: parsed, with one prepared entry
+// per primitive of every mesh, in order
+struct LoadedScene {
+    tinygltf::Model model;
+    std::string err;
+    std::string warn;
+    bool parsed = false;
+    std::vector<PreparedPrimitive> primitives;
+    MeshOptimizationTotals meshTotals;
+};
+
 // New animation-related structures
 struct AnimationSampler {
     std::vector<float> inputs;  // Timestamps
     std::vector<glm::vec4> outputs; // Interpolation values (quaternions or vectors)
     std::string interpolation;
+    int timeline; // Index into Animation::timelineSamplers
 };
 
 struct AnimationChannel {
@@ -78,6 +124,7 @@ struct AnimationChannel {
 struct Animation {
     std::vector<AnimationSampler> samplers;
     std::vector<AnimationChannel> channels;
+    std::vector<int> timelineSamplers; // First sampler reading each distinct input accessor
     float duration;
 };
 
@@ -86,30 +133,19 @@ std::vector<Animation> animations;
 float animationTime = 0.0f;
 bool isAnimationPlaying = true;
 
-// Helper function to interpolate between keyframes
+// Keyframe cursor and current lookup per timeline of the playing animation
+std::vector<KeyframeCursor> timelineCursors;
+std::vector<KeyframeLookup> timelineLookups;
+
+// Helper function to interpolate between keyframes, found once per timeline by LocateKeyframe
 glm::vec4 interpolateKeyframes(
     const AnimationSampler& sampler,
-    float animTime
+    const KeyframeLookup& lookup
 ) {
-    // Find the appropriate keyframes
-    auto it = std::lower_bound(
-        sampler.inputs.begin(),
-        sampler.inputs.end(),
-        animTime
-    );
-
-    // If we're past the last keyframe, return the last value
-    if (it == sampler.inputs.end()) {
-        return sampler.outputs.back();
-    }
-
-    // Find indices of surrounding keyframes
-    size_t nextIndex = std::distance(sampler.inputs.begin(), it);
-    size_t prevIndex = (nextIndex > 0) ? nextIndex - 1 : 0;
-
-    float prevTime = sampler.inputs[prevIndex];
-    float nextTime = sampler.inputs[nextIndex];
-    float t = (animTime - prevTime) / (nextTime - prevTime);
+    // Indices of surrounding keyframes; past the last keyframe this is the last value
+    size_t prevIndex = lookup.index;
+    size_t nextIndex = lookup.next;
+    float t = lookup.factor;
 
     // Linear interpolation
     if (sampler.interpolation == "LINEAR") {
@@ -134,6 +170,9 @@ void parseAnimations(const tinygltf::Model& model) {
         Animation animation;
         animation.duration = 0.0f;
 
+        // Samplers reading the same input accessor share a timeline
+        std::map<int, int> timelineByAccessor;
+
         // Parse samplers
         for (const auto& sampler : anim.samplers) {
             AnimationSampler animSampler;
@@ -178,6 +217,13 @@ void parseAnimations(const tinygltf::Model& model) {
             animSampler.interpolation = sampler.interpolation.empty() ?
                 "LINEAR" : sampler.interpolation;
 
+            auto timeline = timelineByAccessor.find(sampler.input);
+            if (timeline == timelineByAccessor.end()) {
+                timeline = timelineByAccessor.insert(std::make_pair(sampler.input, (int)animation.timelineSamplers.size())).first;
+                animation.timelineSamplers.push_back((int)animation.samplers.size());
+            }
+            animSampler.timeline = timeline->second;
+
             animation.samplers.push_back(animSampler);
         }
 
@@ -296,8 +342,129 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     cameraFront = glm::normalize(front);
 }
 
-int main()
+// Shader location of a glTF attribute, or -1 if the shader does not read it
+int GetAttributeLocation(const std::string& name) {
+    if (name == "POSITION") {
+        return 0;
+    } else if (name == "NORMAL") {
+        return 1;
+    } else if (name == "TEXCOORD_0") {
+        return 2;
+    }
+    return -1;
+}
+
+// Run an indexed triangle primitive through OptimizeMesh, interleaving the attributes the
+// shader reads. Needs no GL context. Returns false, leaving prepared untouched, for other
+// primitives.
+bool optimizePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                       PreparedPrimitive& prepared, MeshOptimizationTotals& totals) {
+    if (primitive.indices < 0 || primitive.mode != TINYGLTF_MODE_TRIANGLES) {
+        return false;
+    }
+    const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+    const tinygltf::BufferView& indexView = model.bufferViews[indexAccessor.bufferView];
+    size_t indexSize = GetComponentSizeInBytes(indexAccessor.componentType);
+    if (indexAccessor.count < 3 || (indexSize != 1 && indexSize != 2 && indexSize != 4)) {
+        return false;
+    }
+    std::vector<uint32_t> indices;
+    UnpackIndices(&model.buffers[indexView.buffer].data[indexView.byteOffset + indexAccessor.byteOffset],
+                  indexAccessor.count, indexSize, indices);
+    uint32_t maxIndex = *std::max_element(indices.begin(), indices.end());
+
+    std::vector<MeshStream> streams;
+    std::vector<const tinygltf::Accessor*> streamAccessors;
+    std::vector<int> streamLocations;
+    int positionStream = -1;
+    for (const auto& attrib : primitive.attributes) {
+        int loc = GetAttributeLocation(attrib.first);
+        const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+        if (loc < 0) {
+            continue;
+        }
+        if (maxIndex >= accessor.count) {
+            return false;
+        }
+        const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+        MeshStream stream;
+        stream.size = GetComponentSizeInBytes(accessor.componentType) * GetNumComponentsInType(accessor.type);
+        int byteStride = accessor.ByteStride(bufferView);
+        stream.stride = byteStride > 0 ? byteStride : stream.size;
+        stream.data = &model.buffers[bufferView.buffer].data[bufferView.byteOffset + accessor.byteOffset];
+        if (loc == 0 && accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && accessor.type == TINYGLTF_TYPE_VEC3) {
+            positionStream = (int)streams.size();
+        }
+        streams.push_back(stream);
+        streamAccessors.push_back(&accessor);
+        streamLocations.push_back(loc);
+    }
+
+    OptimizedMesh& mesh = prepared.mesh;
+    OptimizeMesh(indices, streams.data(), streams.size(), positionStream, mesh);
+    prepared.optimized = true;
+    prepared.streamAccessors = streamAccessors;
+    prepared.streamLocations = streamLocations;
+
+    // Counted only now that every stream was accepted
+    totals.triangles += mesh.indexCount / 3;
+    totals.sourceCacheMisses += mesh.sourceCacheMisses;
+    totals.cacheMisses += mesh.cacheMisses;
+    totals.sourceBytes += indexAccessor.count * indexSize;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        totals.sourceBytes += streamAccessors[i]->count * streams[i].size;
+    }
+    totals.bytes += mesh.vertices.size() + mesh.indices.size();
+    return true;
+}
+
+// Upload a prepared primitive: one interleaved VBO and an EBO with 16-bit indices where
+// they fit, recorded in the bound VAO
+void uploadOptimizedPrimitive(const PreparedPrimitive& prepared, GLuint& indexCount, GLuint& indexType) {
+    const OptimizedMesh& mesh = prepared.mesh;
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size(), mesh.vertices.data(), GL_STATIC_DRAW);
+    for (size_t i = 0; i < prepared.streamLocations.size(); ++i) {
+        const tinygltf::Accessor& accessor = *prepared.streamAccessors[i];
+        glEnableVertexAttribArray(prepared.streamLocations[i]);
+        glVertexAttribPointer(prepared.streamLocations[i], GetNumComponentsInType(accessor.type), accessor.componentType,
+            accessor.normalized ? GL_TRUE : GL_FALSE, mesh.vertexSize, BUFFER_OFFSET(mesh.streamOffsets[i]));
+    }
+
+    GLuint ebo;
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
+    indexCount = mesh.indexCount;
+    indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// Parse a model and prepare its meshes; runs on a worker so the window keeps drawing
+void loadScene(LoadedScene& scene, const char* filename) {
+    scene.parsed = LoadGLTFFile(scene.model, filename, scene.err, scene.warn);
+    if (!scene.parsed) {
+        return;
+    }
+    for (const auto& mesh : scene.model.meshes) {
+        for (const auto& primitive : mesh.primitives) {
+            scene.primitives.emplace_back();
+            if (optimizeMeshes) {
+                optimizePrimitive(scene.model, primitive, scene.primitives.back(), scene.meshTotals);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
 {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--raw-meshes") {
+            optimizeMeshes = false;
+        }
+    }
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW\n";
@@ -338,21 +505,37 @@ int main()
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    // Load the glTF model using TinyGLTF
-    tinygltf::Model model;
-    tinygltf::TinyGLTF loader;
-    std::string err_str;
-    std::string warn_str;
-
-    // Load the model from a file (save your JSON content to 'model.gltf')
-    bool ret = loader.LoadASCIIFromFile(&model, &err_str, &warn_str, "../lab4/model/car/scene.gltf");
-    if (!warn_str.empty()) {
-        std::cout << "Warn: " << warn_str << std::endl;
+    // Load the model from a file, .gltf or .glb, on a background job and keep the window
+    // drawing until it is parsed and its meshes are prepared
+    StartJobSystem(GetDefaultJobWorkerCount());
+    LoadedScene scene;
+    bool sceneLoaded = false;
+    SubmitBackgroundJob([&scene, &sceneLoaded]() {
+        loadScene(scene, "../lab4/model/car/scene.gltf");
+        PostMainThreadTask([&sceneLoaded]() { sceneLoaded = true; });
+    });
+    while (!sceneLoaded && !glfwWindowShouldClose(window)) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        RunMainThreadTasks(1);
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    // Closing the window waits for the job, which still references scene
+    StopJobSystem();
+    if (glfwWindowShouldClose(window)) {
+        glfwTerminate();
+        return 0;
+    }
+
+    tinygltf::Model& model = scene.model;
+    if (!scene.warn.empty()) {
+        std::cout << "Warn: " << scene.warn << std::endl;
     }
-    if (!err_str.empty()) {
-        std::cerr << "Err: " << err_str << std::endl;
+    if (!scene.err.empty()) {
+        std::cerr << "Err: " << scene.err << std::endl;
     }
-    if (!ret) {
+    if (!scene.parsed) {
         std::cerr << "Failed to parse glTF\n";
         return -1;
     }
@@ -379,6 +562,8 @@ int main()
     std::vector<Material> materials;
 
     // Prepare buffers for rendering
+    const MeshOptimizationTotals& meshTotals = scene.meshTotals;
+    size_t primitiveIndex = 0;
     for (const auto& mesh : model.meshes) {
         for (const auto& primitive : mesh.primitives) {
             // Create VAO
@@ -386,6 +571,19 @@ int main()
             glGenVertexArrays(1, &vao);
             glBindVertexArray(vao);
 
+            // Indexed triangles went through the mesh import stage, anything else is uploaded as authored
+            const PreparedPrimitive& prepared = scene.primitives[primitiveIndex++];
+            Primitive optimizedPrim;
+            if (prepared.optimized) {
+                uploadOptimizedPrimitive(prepared, optimizedPrim.indexCount, optimizedPrim.indexType);
+                optimizedPrim.vao = vao;
+                optimizedPrim.mode = primitive.mode;
+                optimizedPrim.materialIndex = primitive.material;
+                primitives.push_back(optimizedPrim);
+                glBindVertexArray(0);
+                continue;
+            }
+
             // Prepare VBOs for attributes
             for (const auto& attrib : primitive.attributes) {
                 const tinygltf::Accessor& accessor = model.accessors[attrib.second];
@@ -408,14 +606,7 @@ int main()
                     byteStride = numComponents * componentSize;
                 }
 
-                int loc = -1;
-                if (attrib.first == "POSITION") {
-                    loc = 0;
-                } else if (attrib.first == "NORMAL") {
-                    loc = 1;
-                } else if (attrib.first == "TEXCOORD_0") {
-                    loc = 2;
-                }
+                int loc = GetAttributeLocation(attrib.first);
                 if (loc >= 0) {
                     glEnableVertexAttribArray(loc);
                     glVertexAttribPointer(loc, numComponents, accessor.componentType,
@@ -455,6 +646,13 @@ int main()
         }
     }
 
+    if (meshTotals.triangles > 0) {
+        std::cout << std::fixed << std::setprecision(2) << "Optimized meshes: ACMR "
+                  << (float)meshTotals.sourceCacheMisses / meshTotals.triangles << " -> "
+                  << (float)meshTotals.cacheMisses / meshTotals.triangles << ", " << meshTotals.sourceBytes
+                  << " -> " << meshTotals.bytes << " bytes" << std::endl;
+    }
+
     for (const auto& mat : model.materials) {
         Material material;
 
@@ -527,6 +725,10 @@ int main()
     int frameCount = 0;
     // After loading the model, parse animations
     parseAnimations(model);
+    if (!animations.empty()) {
+        timelineCursors.assign(animations[0].timelineSamplers.size(), MakeKeyframeCursor());
+        timelineLookups.resize(animations[0].timelineSamplers.size());
+    }
     // Render loop
     // Render loop
     while (!glfwWindowShouldClose(window)) {
@@ -574,10 +776,16 @@ int main()
             glm::vec3 axis_z(1, 0, 0);
             model_matrix = glm::rotate(model_matrix, angle, axis_z);
             */
+            // Find the keyframes once per timeline, continuing from last frame's position
+            for (size_t i = 0; i < currentAnimation.timelineSamplers.size(); ++i) {
+                const auto& times = currentAnimation.samplers[currentAnimation.timelineSamplers[i]].inputs;
+                timelineLookups[i] = LocateKeyframe(times, animationTime, timelineCursors[i]);
+            }
+
             // Update model transformations based on animation
             for (const auto& channel : currentAnimation.channels) {
                 const auto& sampler = currentAnimation.samplers[channel.samplerIndex];
-                glm::vec4 animValue = interpolateKeyframes(sampler, animationTime);
+                glm::vec4 animValue = interpolateKeyframes(sampler, timelineLookups[sampler.timeline]);
 
                 if (channel.targetPath == "translation") {
                     // Apply translation
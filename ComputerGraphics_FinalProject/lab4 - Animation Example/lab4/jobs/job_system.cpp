@@ -0,0 +1,285 @@
+#include "job_system.h"
+
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One chunk of a ParallelFor
+struct Job {
+	const std::function<void(int, int)> *body;
+	int begin;
+	int end;
+};
+
+struct JobQueue {
+	std::mutex mutex;
+	std::deque<Job> jobs;
+};
+
+// Node of the main thread task list
+struct MainThreadTask {
+	std::function<void()> task;
+	MainThreadTask *next;
+};
+
+struct JobSystemState {
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<JobQueue> > queues;	// Queue 0 belongs to the ParallelFor caller
+
+	// Shared by every worker and taken oldest first
+	std::mutex backgroundMutex;
+	std::deque<std::function<void()> > backgroundJobs;
+	std::atomic<int> queuedBackgroundJobs;
+
+	// Producers push onto postedTasks, newest first, with compare-and-swap. The main thread
+	// takes the whole list at once and keeps it oldest first in readyTasks, its own list.
+	std::atomic<MainThreadTask*> postedTasks;
+	MainThreadTask *readyTasks;
+
+	// Sleeping workers wait here until jobs are queued or the system stops
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	std::atomic<int> queuedJobs;	// Pushed and not yet taken by any thread
+	std::atomic<int> pendingJobs;	// Pushed and not yet finished
+};
+
+static JobSystemState jobSystem;
+
+static bool TakeBackgroundJob(std::function<void()> &task)
+{
+	std::lock_guard<std::mutex> lock(jobSystem.backgroundMutex);
+	if (jobSystem.backgroundJobs.empty()) {
+		return false;
+	}
+	task.swap(jobSystem.backgroundJobs.front());
+	jobSystem.backgroundJobs.pop_front();
+	jobSystem.queuedBackgroundJobs.fetch_sub(1);
+	return true;
+}
+
+// Move everything posted so far behind the tasks already taken, reversed to oldest first
+static void TakePostedTasks()
+{
+	MainThreadTask *posted = jobSystem.postedTasks.exchange(NULL, std::memory_order_acquire);
+	MainThreadTask *reversed = NULL;
+	while (posted != NULL) {
+		MainThreadTask *next = posted->next;
+		posted->next = reversed;
+		reversed = posted;
+		posted = next;
+	}
+	MainThreadTask **tail = &jobSystem.readyTasks;
+	while (*tail != NULL) {
+		tail = &(*tail)->next;
+	}
+	*tail = reversed;
+}
+
+// The owner works newest-first so the chunk it pushed last is still warm in its cache
+static bool PopJob(int queueIndex, Job &job)
+{
+	JobQueue &queue = *jobSystem.queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty()) {
+		return false;
+	}
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	return true;
+}
+
+// Thieves take the oldest job from the other end, away from the owner
+static bool StealJob(int thief, Job &job)
+{
+	int queueCount = (int)jobSystem.queues.size();
+	for (int i = 1; i < queueCount; ++i) {
+		JobQueue &queue = *jobSystem.queues[(thief + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool TakeJob(int queueIndex, Job &job)
+{
+	if (PopJob(queueIndex, job) || StealJob(queueIndex, job)) {
+		jobSystem.queuedJobs.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+static void RunJob(const Job &job)
+{
+	(*job.body)(job.begin, job.end);
+	jobSystem.pendingJobs.fetch_sub(1);
+}
+
+static void WorkerLoop(int queueIndex)
+{
+	for (;;) {
+		Job job;
+		if (TakeJob(queueIndex, job)) {
+			RunJob(job);
+			continue;
+		}
+		std::function<void()> task;
+		if (TakeBackgroundJob(task)) {
+			task();
+			continue;
+		}
+
+		// Background jobs still queued are finished before stopping, so their results get posted
+		std::unique_lock<std::mutex> lock(jobSystem.wakeMutex);
+		jobSystem.wake.wait(lock, [] {
+			return jobSystem.stopping || jobSystem.queuedJobs.load() > 0 || jobSystem.queuedBackgroundJobs.load() > 0;
+		});
+		if (jobSystem.stopping && jobSystem.queuedBackgroundJobs.load() == 0) {
+			return;
+		}
+	}
+}
+
+void StartJobSystem(int workerCount)
+{
+	StopJobSystem();
+
+	jobSystem.stopping = false;
+	jobSystem.queuedJobs = 0;
+	jobSystem.pendingJobs = 0;
+	jobSystem.queuedBackgroundJobs = 0;
+	for (int i = 0; i <= workerCount; ++i) {
+		jobSystem.queues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+	}
+	for (int i = 1; i <= workerCount; ++i) {
+		jobSystem.workers.push_back(std::thread(WorkerLoop, i));
+	}
+}
+
+void StopJobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobSystem.wakeMutex);
+		jobSystem.stopping = true;
+	}
+	jobSystem.wake.notify_all();
+	for (size_t i = 0; i < jobSystem.workers.size(); ++i) {
+		jobSystem.workers[i].join();
+	}
+	jobSystem.workers.clear();
+	jobSystem.queues.clear();
+	jobSystem.backgroundJobs.clear();
+
+	// Run what the finished jobs posted, such as releasing an asset dropped while it loaded
+	while (RunMainThreadTasks(INT_MAX) > 0) {
+	}
+}
+
+int GetJobWorkerCount()
+{
+	return (int)jobSystem.workers.size();
+}
+
+int GetDefaultJobWorkerCount()
+{
+	int hardwareThreads = (int)std::thread::hardware_concurrency();
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+void ParallelFor(int count, int grainSize, const std::function<void(int, int)> &body)
+{
+	if (count <= 0) {
+		return;
+	}
+	if (grainSize < 1) {
+		grainSize = 1;
+	}
+	if (jobSystem.workers.empty() || count <= grainSize) {
+		body(0, count);
+		return;
+	}
+
+	// Give each thread a contiguous run of chunks; stealing evens out the rest
+	int chunkCount = (count + grainSize - 1) / grainSize;
+	int queueCount = (int)jobSystem.queues.size();
+	jobSystem.pendingJobs.fetch_add(chunkCount);
+	for (int chunk = 0; chunk < chunkCount; ++chunk) {
+		Job job;
+		job.body = &body;
+		job.begin = chunk * grainSize;
+		job.end = job.begin + grainSize < count ? job.begin + grainSize : count;
+
+		JobQueue &queue = *jobSystem.queues[(long long)chunk * queueCount / chunkCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobSystem.wakeMutex);
+		jobSystem.queuedJobs.fetch_add(chunkCount);
+	}
+	jobSystem.wake.notify_all();
+
+	// The caller works as thread 0 until every chunk, including stolen ones, is done
+	while (jobSystem.pendingJobs.load() > 0) {
+		Job job;
+		if (TakeJob(0, job)) {
+			RunJob(job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void SubmitBackgroundJob(const std::function<void()> &task)
+{
+	if (jobSystem.workers.empty()) {
+		task();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobSystem.backgroundMutex);
+		jobSystem.backgroundJobs.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobSystem.wakeMutex);
+		jobSystem.queuedBackgroundJobs.fetch_add(1);
+	}
+	jobSystem.wake.notify_one();
+}
+
+void PostMainThreadTask(const std::function<void()> &task)
+{
+	MainThreadTask *node = new MainThreadTask();
+	node->task = task;
+	node->next = jobSystem.postedTasks.load(std::memory_order_relaxed);
+
+	// Release publishes everything the producer wrote before posting
+	while (!jobSystem.postedTasks.compare_exchange_weak(node->next, node, std::memory_order_release,
+		std::memory_order_relaxed)) {
+	}
+}
+
+int RunMainThreadTasks(int maxTasks)
+{
+	TakePostedTasks();
+	int ran = 0;
+	while (jobSystem.readyTasks != NULL && ran < maxTasks) {
+		MainThreadTask *node = jobSystem.readyTasks;
+		jobSystem.readyTasks = node->next;
+		node->task();
+		delete node;
+		ran++;
+	}
+	return ran;
+}
@@ -0,0 +1,40 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <functional>
+
+// Work-stealing thread pool. Each thread, including the caller of ParallelFor, owns a
+// queue of range jobs: it takes its newest job from the back, and once its own queue is
+// empty steals the oldest job from the front of another thread's queue.
+//
+// Long tasks such as loading files run as background jobs, which only workers take and
+// only while no range jobs are queued. They hand results back to the thread that started
+// the system, usually the GL thread, through PostMainThreadTask.
+
+// Start workerCount threads in addition to the calling thread; 0 runs everything inline
+void StartJobSystem(int workerCount);
+
+// Finishes running and queued background jobs, then runs the main thread tasks they posted.
+// Must be called from the thread that started the system.
+void StopJobSystem();
+
+int GetJobWorkerCount();
+
+// Worker count that leaves one hardware thread for the caller
+int GetDefaultJobWorkerCount();
+
+// Run body(begin, end) over [0, count) in chunks of at most grainSize, and return once
+// every chunk has finished. Must be called from the thread that started the system.
+void ParallelFor(int count, int grainSize, const std::function<void(int, int)> &body);
+
+// Run task on a worker without waiting for it. With no workers it runs before returning.
+void SubmitBackgroundJob(const std::function<void()> &task);
+
+// Queue task for the next RunMainThreadTasks. Lock-free and callable from any thread.
+void PostMainThreadTask(const std::function<void()> &task);
+
+// Run up to maxTasks posted tasks, oldest first, and return how many ran. Must be called
+// from the thread that started the system.
+int RunMainThreadTasks(int maxTasks);
+
+#endif
@@ -11,12 +11,28 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <tiny_gltf.h>
 #include <render/shader.h>
+#include <render/joint_palette.h>
+#include <render/baked_animation.h>
+#include <render/staging_buffer.h>
+#include <animation/keyframe.h>
+#include <animation/skeleton.h>
+#include <jobs/job_system.h>
+#include <asset/cooked_file.h>
+#include <asset/mapped_file.h>
+#include <asset/gltf_file.h>
+#include <asset/mesh_optimizer.h>
 
 #include <vector>
 #include <iostream>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <cfloat>
+#include <algorithm>
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
@@ -41,27 +57,136 @@ static glm::vec3 lightPosition(-275.0f, 500.0f, 800.0f);
 // Animation
 static bool playAnimation = true;
 static float playbackSpeed = 2.0f;
+static bool useAnimationLOD = true;
+static bool useBakedCrowd = false;
+
+// Run the mesh_optimizer import stage over glTF geometry; --raw-meshes uploads it as authored
+static bool optimizeMeshes = true;
+
+// Animation level of detail, chosen per character from its projected size
+struct AnimationLOD {
+	float minScreenSize;	// Smallest projected height using this tier, as a fraction of the viewport
+	int updateInterval;		// Frames between pose evaluations, 0 to hold the last pose
+	int droppedDepths;		// Deepest skeleton levels left unanimated
+};
+static const int AnimationLODCount = 4;
+static const AnimationLOD animationLODs[AnimationLODCount] = {
+	{ 0.25f, 1, 0 },
+	{ 0.10f, 2, 1 },
+	{ 0.04f, 4, 2 },
+	{ 0.0f, 0, 2 }
+};
+
+// Cooked model files: "L4MD", bumped whenever ModelAsset::saveCooked changes what it writes
+static const uint32_t CookedModelMagic = 0x444d344c;
+static const uint32_t CookedModelVersion = 2;
+
+// Cooked file kept next to a glTF file
+static std::string GetCookedModelPath(const char *filename)
+{
+	return std::string(filename) + ".cooked";
+}
+
+// Geometry larger than one slice is uploaded through this buffer, created with the GL context
+static const size_t UploadSliceSize = 256 * 1024;
+static StagingBuffer uploadStaging;
+
+// Assets loaded in the background that are uploaded per frame at most, so a burst of
+// finished loads does not stall a single frame
+static const int AssetUploadsPerFrame = 1;
+
+// Everything loaded from one glTF file that does not change per character: the parsed model,
+// GPU buffers, program, compiled animation clips and inverse bind matrices. Shared by every
+// ModelInstance of the file and reference counted through AcquireModelAsset/ReleaseModelAsset.
+struct ModelAsset {
+	std::string filename;
+	int refCount = 0;
+
+	// Only touched on the GL thread: loading is set while a worker runs load(), and failed
+	// once it returned false
+	bool loading = false;
+	bool failed = false;
+
+	// Leave out the progress messages of loading, so timed loads measure no console output
+	bool quiet = false;
 
-struct MyBot {
 	// Shader variable IDs
 	GLuint mvpMatrixID;
-	GLuint jointMatricesID;
+	GLuint jointPaletteID;
+	GLuint jointCountID;
+	GLuint paletteOffsetID;
 	GLuint lightPositionID;
 	GLuint lightIntensityID;
 	GLuint programID;
 
+	// Program skinning from bakedAnimation, created by bake()
+	GLuint bakedProgramID = 0;
+	GLuint bakedMvpMatrixID;
+	GLuint bakedPoseID;
+	GLuint instanceRecordsID;
+	GLuint bakedTimeID;
+	GLuint bakedLoopStartTimeID;
+	GLuint bakedFrameRateID;
+	GLuint bakedFrameCountID;
+	GLuint bakedLightPositionID;
+	GLuint bakedLightIntensityID;
+	BakedAnimation bakedAnimation = BakedAnimation();
+
+	// Parsed glTF file; empty when the asset came from its cooked file, which keeps only
+	// the extracted data below
 	tinygltf::Model model;
 
-	float loopStartTime = 0.5f;  // Start of the loop segment
-	float loopEndTime = 2.5f;    // End of the loop segment
-	bool useLooping = true;      // Flag to enable/disable custom looping
-
-	// Each VAO corresponds to each mesh primitive in the GLTF model
-	struct PrimitiveObject {
-		GLuint vao;
-		std::map<int, GLuint> vbos;
+	// Geometry of the default scene in the order it is drawn, extracted from the glTF
+	// accessors so neither upload nor drawing touches tinygltf. Each bufferView that a
+	// primitive reads becomes one range of the geometry bytes and one GL buffer.
+	struct GeometryRange {
+		size_t offset;			// Byte offset into getGeometryBytes()
+		size_t length;
+	};
+	struct AttributeLayout {
+		GLuint location;
+		GLint size;
+		GLenum componentType;
+		GLboolean normalized;
+		GLboolean integer;		// Read as integers with glVertexAttribIPointer
+		GLsizei stride;
+		size_t offset;			// Byte offset into the range
+		int range;
 	};
-	std::vector<PrimitiveObject> primitiveObjects;
+	struct PrimitiveLayout {
+		int firstAttribute;		// Into attributeLayouts
+		int attributeCount;
+		int indexRange;
+		GLenum mode;
+		GLsizei count;
+		GLenum indexType;
+		size_t indexOffset;		// Byte offset into the index range
+		int material;
+	};
+	// The geometry bytes: the glTF buffers taken over from the parsed model, or the mapped
+	// cooked file. Either is released once uploaded.
+	std::vector<unsigned char> geometryData;
+	MappedFile geometryFile = MappedFile();
+	std::vector<GeometryRange> geometryRanges;
+	std::vector<AttributeLayout> attributeLayouts;
+	std::vector<PrimitiveLayout> primitiveLayouts;
+
+	// One record per mesh primitive in the GLTF model, resolved at load time so a frame
+	// only walks this array: no node recursion, map lookups or tinygltf copies
+	struct DrawRecord {
+		GLuint vao;				// Attributes and index buffer of the primitive
+		GLenum mode;
+		GLsizei count;
+		GLenum indexType;
+		size_t indexOffset;		// Byte offset into the index buffer
+		int material;
+	};
+	std::vector<DrawRecord> drawRecords;
+
+	// One GL buffer per geometry range, uploaded once and shared by every primitive
+	std::vector<GLuint> geometryVBOs;
+	size_t uploadedBytes = 0;		// Bytes uploaded into geometryVBOs
+	size_t perMeshUploadBytes = 0;	// Bytes the old upload of every bufferView per mesh would have used
 
 	// Skinning
 	struct SkinObject {
@@ -71,7 +196,7 @@ struct MyBot {
 		// Transforms the geometry following the movement of the joints
 		std::vector<glm::mat4> globalJointTransforms;
 
-		// Combined transforms
+		// Combined transforms of the rest pose
 		std::vector<glm::mat4> jointMatrices;
 	};
 	std::vector<SkinObject> skinObjects;
@@ -81,20 +206,52 @@ struct MyBot {
 		std::vector<float> input;
 		std::vector<glm::vec4> output;
 		int interpolation;
+		int timeline;		// Index into AnimationObject::timelines
 	};
+	enum ChannelPath {
+		PATH_TRANSLATION,
+		PATH_ROTATION,
+		PATH_SCALE
+	};
+	// Channel compiled at load time, so a frame does no string compares or tinygltf lookups
 	struct ChannelObject {
-		int sampler;
-		std::string targetPath;
-		int targetNode;
+		const SamplerObject *sampler;	// Points into the owning AnimationObject's samplers
+		int samplerIndex;				// Index of sampler there
+		ChannelPath path;
+		int targetSlot;					// Skeleton slot of the target node
 	};
 	struct AnimationObject {
 		std::vector<SamplerObject> samplers;	// Animation data
+		std::vector<ChannelObject> channels;	// Filled by compileAnimation
+
+		// Distinct time inputs; samplers reading the same input accessor share one
+		std::vector<const std::vector<float>*> timelines;
 	};
 	std::vector<AnimationObject> animationObjects;
 
-	glm::mat4 inverseRootTransform;
+	// Read-only after compileAnimation, so any number of poses can be evaluated concurrently
+	Skeleton skeleton;						// Nodes below the skin root, parents first
+	std::vector<int> jointSlots;			// Skeleton slot of each joint of skin 0, -1 outside it
+	SkeletonPose restPose;					// Node TRS from the glTF file, converted from doubles once
+	size_t maxTimelines = 0;
+	int lodSlotCounts[AnimationLODCount];	// Skeleton slots animated at each level of detail
+
+	// Sphere around the bind-pose geometry, for choosing the level of detail
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+
+	// Buffers of one animated pose, owned by each instance and sized once by initAnimationState
+	struct AnimationState {
+		SkeletonPose pose;
+		std::vector<glm::mat4> localTransforms;	// Indexed by skeleton slot
+		std::vector<glm::mat4> globalTransforms;
+
+		// Keyframe cursor and this update's lookup for each timeline
+		std::vector<KeyframeCursor> cursors;
+		std::vector<KeyframeLookup> lookups;
+	};
 
-	glm::mat4 getNodeTransform(const tinygltf::Node& node) {
+	glm::mat4 getNodeTransform(const tinygltf::Node& node) const {
 		glm::mat4 transform(1.0f);
 
 		if (node.matrix.size() == 16) {
@@ -116,7 +273,7 @@ struct MyBot {
 
 	void computeLocalNodeTransform(const tinygltf::Model& model,
 						   int nodeIndex,
-						   std::vector<glm::mat4> &localTransforms)
+						   std::vector<glm::mat4> &localTransforms) const
 	{
 		const tinygltf::Node& node = model.nodes[nodeIndex];
 
@@ -133,7 +290,7 @@ struct MyBot {
 								 const std::vector<glm::mat4> &localTransforms,
 								 int nodeIndex,
 								 const glm::mat4& parentTransform,
-								 std::vector<glm::mat4> &globalTransforms)
+								 std::vector<glm::mat4> &globalTransforms) const
 	{
 		// Combine the parent's transform with the node's local transform.
 		globalTransforms[nodeIndex] = parentTransform * localTransforms[nodeIndex];
@@ -198,7 +355,7 @@ struct MyBot {
 
 
 
-	int findKeyframeIndex(const std::vector<float>& times, float animationTime)
+	int findKeyframeIndex(const std::vector<float>& times, float animationTime) const
 	{
 		int left = 0;
 		int right = times.size() - 1;
@@ -283,12 +440,184 @@ struct MyBot {
 		return animationObjects;
 	}
 
+	// Flatten the skeleton, resolve channel targets and paths, and convert the rest pose, once at load time
+	void compileAnimation(const tinygltf::Model &model) {
+		std::vector<std::vector<int> > children(model.nodes.size());
+		for (size_t i = 0; i < model.nodes.size(); ++i) {
+			children[i] = model.nodes[i].children;
+		}
+		int rootNodeIndex = model.skins.empty() ? -1 : model.skins[0].joints[0];
+		skeleton = BuildSkeleton(children, rootNodeIndex);
+
+		jointSlots.clear();
+		if (!model.skins.empty()) {
+			for (int joint : model.skins[0].joints) {
+				jointSlots.push_back(skeleton.slotOfNode[joint]);
+			}
+		}
+
+		// The sampler pointers stay valid because animationObjects is not resized after this
+		maxTimelines = 0;
+		for (size_t a = 0; a < animationObjects.size(); ++a) {
+			AnimationObject &animationObject = animationObjects[a];
+			animationObject.channels.clear();
+
+			// Group samplers by input accessor so each time array is searched once per update
+			std::map<int, int> timelineByAccessor;
+			animationObject.timelines.clear();
+			for (size_t i = 0; i < animationObject.samplers.size(); ++i) {
+				int inputAccessor = model.animations[a].samplers[i].input;
+				std::map<int, int>::iterator found = timelineByAccessor.find(inputAccessor);
+				if (found == timelineByAccessor.end()) {
+					found = timelineByAccessor.insert(std::make_pair(inputAccessor, (int)animationObject.timelines.size())).first;
+					animationObject.timelines.push_back(&animationObject.samplers[i].input);
+				}
+				animationObject.samplers[i].timeline = found->second;
+			}
+			maxTimelines = std::max(maxTimelines, animationObject.timelines.size());
+			if (!quiet) {
+				std::cout << "Animation " << a << ": " << animationObject.samplers.size() << " samplers share "
+						  << animationObject.timelines.size() << " time inputs" << std::endl;
+			}
+
+			for (const auto &channel : model.animations[a].channels) {
+				ChannelObject channelObject;
+				if (channel.target_path == "translation") {
+					channelObject.path = PATH_TRANSLATION;
+				} else if (channel.target_path == "rotation") {
+					channelObject.path = PATH_ROTATION;
+				} else if (channel.target_path == "scale") {
+					channelObject.path = PATH_SCALE;
+				} else {
+					std::cout << "Unsupported animation path: " << channel.target_path << std::endl;
+					continue;
+				}
+				// Channels on nodes outside the skeleton never reach a joint
+				channelObject.targetSlot = skeleton.slotOfNode[channel.target_node];
+				if (channelObject.targetSlot < 0) {
+					continue;
+				}
+				channelObject.sampler = &animationObject.samplers[channel.sampler];
+				channelObject.samplerIndex = channel.sampler;
+				animationObject.channels.push_back(channelObject);
+			}
+		}
+
+		int slotCount = (int)skeleton.nodes.size();
+		restPose.resize(slotCount);
+		for (int slot = 0; slot < slotCount; ++slot) {
+			const tinygltf::Node &node = model.nodes[skeleton.nodes[slot]];
+			if (node.translation.size() == 3) {
+				restPose.setTranslation(slot, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+			}
+			if (node.rotation.size() == 4) {
+				restPose.setRotation(slot, glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]));
+			}
+			if (node.scale.size() == 3) {
+				restPose.setScale(slot, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+			}
+		}
+
+		// Sample channels parents first, so reduced tiers can stop at their last joint
+		for (size_t a = 0; a < animationObjects.size(); ++a) {
+			std::vector<ChannelObject> &channels = animationObjects[a].channels;
+			std::stable_sort(channels.begin(), channels.end(), [](const ChannelObject &x, const ChannelObject &y) {
+				return x.targetSlot < y.targetSlot;
+			});
+		}
+		computeLODSlotCounts();
+	}
+
+	// Joints evaluated by each level of detail: drop the deepest levels of the hierarchy
+	void computeLODSlotCounts() {
+		int slotCount = (int)skeleton.nodes.size();
+		int maxDepth = slotCount > 0 ? skeleton.depths[slotCount - 1] : 0;
+		for (int level = 0; level < AnimationLODCount; ++level) {
+			int depthLimit = std::max(0, maxDepth - animationLODs[level].droppedDepths);
+			int activeSlots = 0;
+			while (activeSlots < slotCount && skeleton.depths[activeSlots] <= depthLimit) {
+				activeSlots++;
+			}
+			lodSlotCounts[level] = activeSlots;
+		}
+	}
+
+	void initAnimationState(AnimationState &state) const {
+		state.pose = restPose;
+
+		// Slots a reduced tier does not animate hold the rest pose until a full update reaches them
+		state.localTransforms.resize(skeleton.nodes.size());
+		ComposeLocalTransforms(restPose, (int)skeleton.nodes.size(), state.localTransforms.data());
+		state.globalTransforms.assign(skeleton.nodes.size(), glm::mat4(1.0f));
+		state.cursors.assign(maxTimelines, MakeKeyframeCursor());
+		state.lookups.resize(maxTimelines);
+	}
+
+	// Sample the compiled channels into state's local and global transforms without allocating.
+	// Only state is written, so separate states can be evaluated on separate threads.
+	// Slots from activeSlots on keep their previous local transforms.
+	void evaluateAnimation(const AnimationObject &animationObject, float time, AnimationState &state,
+						   int activeSlots) const {
+		SkeletonPose &pose = state.pose;
+		pose = restPose;
+
+		// Find the keyframes once per timeline, continuing from last update's position
+		for (size_t i = 0; i < animationObject.timelines.size(); ++i) {
+			const std::vector<float> &times = *animationObject.timelines[i];
+
+			// Calculate current animation time (wrap if necessary)
+			float animationTime = fmod(time, times.back());
+			state.lookups[i] = LocateKeyframe(times, animationTime, state.cursors[i]);
+		}
+
+		for (const ChannelObject &channel : animationObject.channels) {
+			if (channel.targetSlot >= activeSlots) {
+				break;
+			}
+			const KeyframeLookup &lookup = state.lookups[channel.sampler->timeline];
+			const std::vector<glm::vec4> &outputs = channel.sampler->output;
+			float factor = lookup.factor;
+
+			const glm::vec4 &value0 = outputs[lookup.index];
+			const glm::vec4 &value1 = outputs[lookup.next];
+			switch (channel.path) {
+			case PATH_TRANSLATION:
+				pose.setTranslation(channel.targetSlot, glm::mix(glm::vec3(value0), glm::vec3(value1), factor));
+				break;
+			case PATH_ROTATION:
+				pose.setRotation(channel.targetSlot, glm::slerp(glm::quat(value0.w, value0.x, value0.y, value0.z),
+																glm::quat(value1.w, value1.x, value1.y, value1.z), factor));
+				break;
+			case PATH_SCALE:
+				pose.setScale(channel.targetSlot, glm::mix(glm::vec3(value0), glm::vec3(value1), factor));
+				break;
+			}
+		}
+
+		// Reconstruct node transforms, four slots at a time
+		ComposeLocalTransforms(pose, activeSlots, state.localTransforms.data());
+
+		// Recompute global transforms in one pass over the parent-first skeleton
+		ConcatenateHierarchy(skeleton, state.localTransforms.data(), glm::mat4(1.0f), state.globalTransforms.data());
+	}
+
+	// Joint matrices of one skin for an evaluated pose, with worldTransform folded in
+	void computeJointMatrices(const AnimationState &state, const SkinObject &skinObject,
+							  const glm::mat4 &worldTransform, std::vector<glm::mat4> &jointMatrices) const {
+		for (size_t i = 0; i < jointMatrices.size(); ++i) {
+			int slot = jointSlots[i];
+			glm::mat4 globalTransform = slot < 0 ? worldTransform : worldTransform * state.globalTransforms[slot];
+			jointMatrices[i] = globalTransform * skinObject.inverseBindMatrices[i];
+		}
+	}
+
+	// Original per-frame evaluation, kept as the reference for the animation benchmark
 	void updateAnimation(
     const tinygltf::Model &model,
     const tinygltf::Animation &anim,
     const AnimationObject &animationObject,
     float time,
-    std::vector<glm::mat4> &nodeTransforms)
+    std::vector<glm::mat4> &nodeTransforms) const
 {
     // For each node, store separate components
     struct TransformComponents {
@@ -378,76 +707,100 @@ struct MyBot {
 }
 
 
-	void updateSkinning(const tinygltf::Skin &skin, const std::vector<glm::mat4> &nodeTransforms) {
-		for (SkinObject &skinObject : skinObjects) {
-			// Loop through each joint in the skin
-			for (size_t i = 0; i < skinObject.jointMatrices.size(); ++i) {
-				int jointIndex = skin.joints[i];
-				// Compute the joint matrix: Global transform * Inverse bind matrix
-				skinObject.jointMatrices[i] = nodeTransforms[jointIndex] * skinObject.inverseBindMatrices[i];
-			}
-		}
-	}
-
+	// Joint matrices of skin 0 at an animation time through the original per-frame path
+	void evaluateReference(float animationTime, const glm::mat4 &rootTransform, std::vector<glm::mat4> &jointMatrices) const {
+		if (model.animations.size() > 0) {
+			const tinygltf::Animation &animation = model.animations[0];
+			const AnimationObject &animationObject = animationObjects[0];
 
+			const tinygltf::Skin &skin = model.skins[0];
+			std::vector<glm::mat4> localTransforms(model.nodes.size(), glm::mat4(1.0f));
+			int rootNodeIndex = skin.joints[0];
 
-	void update(float time) {
-        if (model.animations.size() > 0) {
-            const tinygltf::Animation &animation = model.animations[0];
-            const AnimationObject &animationObject = animationObjects[0];
+			// Initialize localTransforms with initial node transforms
+			computeLocalNodeTransform(model, rootNodeIndex, localTransforms);
 
-            const tinygltf::Skin &skin = model.skins[0];
-            std::vector<glm::mat4> localTransforms(model.nodes.size(), glm::mat4(1.0f));
-            int rootNodeIndex = skin.joints[0];
+			// Update local transforms with animation data
+			updateAnimation(model, animation, animationObject, animationTime, localTransforms);
 
-            // Initialize localTransforms with initial node transforms
-            computeLocalNodeTransform(model, rootNodeIndex, localTransforms);
-
-            // Determine the animation time
-            float animationTime;
-            if (useLooping) {
-                // Calculate total animation duration from input times
-                float totalDuration = animationObject.samplers[0].input.back();
-
-                // If current time is before loop start, reset to loop start
-                if (time < loopStartTime) {
-                    animationTime = loopStartTime;
-                }
-                // If current time is past loop end, wrap back to loop start
-                else if (time > loopEndTime) {
-                    // Adjust time to loop segment
-                    animationTime = loopStartTime +
-                        fmod(time - loopEndTime, loopEndTime - loopStartTime);
-                }
-                // Otherwise, use the current time
-                else {
-                    animationTime = time;
-                }
-            } else {
-                // Default behavior - use full animation duration
-                animationTime = time;
-            }
+			// Recompute global transforms
+			std::vector<glm::mat4> globalTransforms(model.nodes.size(), glm::mat4(1.0f));
+			computeGlobalNodeTransform(model, localTransforms, rootNodeIndex, rootTransform, globalTransforms);
 
-            // Update local transforms with animation data
-            updateAnimation(model, animation, animationObject, animationTime, localTransforms);
+			// Update skinning
+			updateSkinning(skin, globalTransforms, jointMatrices);
+		}
+	}
 
-            // Recompute global transforms
-            std::vector<glm::mat4> globalTransforms(model.nodes.size(), glm::mat4(1.0f));
-            computeGlobalNodeTransform(model, localTransforms, rootNodeIndex, glm::mat4(1.0f), globalTransforms);
+	// Sample the looped segment [startTime, endTime) of animation 0 at close to frameRate
+	// at full detail. Returns frameCount frames of getJointCount() matrices; frameRate is
+	// adjusted so the frames split the segment evenly.
+	std::vector<glm::mat4> bakeAnimationFrames(float startTime, float endTime, float &frameRate, int &frameCount) const {
+		float duration = endTime - startTime;
+		frameCount = std::max(1, (int)ceil(duration * frameRate - 1e-3f));
+		frameRate = frameCount / duration;
+
+		int jointCount = getJointCount();
+		std::vector<glm::mat4> frames(frameCount * jointCount);
+		std::vector<glm::mat4> jointMatrices(jointCount);
+		AnimationState state;
+		initAnimationState(state);
+		for (int frame = 0; frame < frameCount; ++frame) {
+			evaluateAnimation(animationObjects[0], startTime + frame / frameRate, state, (int)skeleton.nodes.size());
+			computeJointMatrices(state, skinObjects[0], glm::mat4(1.0f), jointMatrices);
+			std::copy(jointMatrices.begin(), jointMatrices.end(), frames.begin() + frame * jointCount);
+		}
+		return frames;
+	}
 
-            // Update skinning
-            updateSkinning(model.skins[0], globalTransforms);
-        }
-    }
+	// Bake the looped segment into a texture and load the program that plays it back
+	bool bake(float startTime, float endTime, float frameRate) {
+		if (bakedAnimation.textureID != 0) {
+			return true;
+		}
+		if (animationObjects.empty() || skinObjects.empty()) {
+			return false;
+		}
 
+		bakedProgramID = LoadShadersFromFile("../lab4/shader/bot_baked.vert", "../lab4/shader/bot.frag");
+		if (bakedProgramID == 0) {
+			std::cerr << "Failed to load shaders." << std::endl;
+			return false;
+		}
+		bakedMvpMatrixID = glGetUniformLocation(bakedProgramID, "MVP");
+		bakedPoseID = glGetUniformLocation(bakedProgramID, "bakedPose");
+		instanceRecordsID = glGetUniformLocation(bakedProgramID, "instanceRecords");
+		bakedTimeID = glGetUniformLocation(bakedProgramID, "time");
+		bakedLoopStartTimeID = glGetUniformLocation(bakedProgramID, "loopStartTime");
+		bakedFrameRateID = glGetUniformLocation(bakedProgramID, "frameRate");
+		bakedFrameCountID = glGetUniformLocation(bakedProgramID, "frameCount");
+		bakedLightPositionID = glGetUniformLocation(bakedProgramID, "lightPosition");
+		bakedLightIntensityID = glGetUniformLocation(bakedProgramID, "lightIntensity");
+
+		int frameCount;
+		std::vector<glm::mat4> frames = bakeAnimationFrames(startTime, endTime, frameRate, frameCount);
+		bakedAnimation = CreateBakedAnimation(frames, frameCount, getJointCount(), frameRate, startTime);
+		std::cout << "Baked animation 0: " << frameCount << " frames x " << getJointCount() << " joints at "
+				  << frameRate << " fps = " << bakedAnimation.bytes / 1024.0f << " KB" << std::endl;
+		return true;
+	}
 
+	void updateSkinning(const tinygltf::Skin &skin, const std::vector<glm::mat4> &nodeTransforms,
+						std::vector<glm::mat4> &jointMatrices) const {
+		const SkinObject &skinObject = skinObjects[0];
+		// Loop through each joint in the skin
+		for (size_t i = 0; i < jointMatrices.size(); ++i) {
+			int jointIndex = skin.joints[i];
+			// Compute the joint matrix: Global transform * Inverse bind matrix
+			jointMatrices[i] = nodeTransforms[jointIndex] * skinObject.inverseBindMatrices[i];
+		}
+	}
 
 	bool loadModel(tinygltf::Model &model, const char *filename) {
-		tinygltf::TinyGLTF loader;
 		std::string err;
 		std::string warn;
 
-		bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+		bool res = LoadGLTFFile(model, filename, err, warn);
 		if (!warn.empty()) {
 			std::cout << "WARN: " << warn << std::endl;
 		}
@@ -458,26 +811,341 @@ struct MyBot {
 
 		if (!res)
 			std::cout << "Failed to load glTF: " << filename << std::endl;
-		else
+		else if (!quiet)
 			std::cout << "Loaded glTF: " << filename << std::endl;
 
 		return res;
 	}
 
-	void initialize() {
-		// Modify your path if needed
-		if (!loadModel(model, "../lab4/model/bot/bot.gltf")) {
-			return;
+	// Parse the glTF file and prepare skinning, animation and geometry data, without touching GL
+	bool loadSource(const char *path) {
+		if (!loadModel(model, path)) {
+			return false;
 		}
 
-		// Prepare buffers for rendering
-		primitiveObjects = bindModel(model);
-
 		// Prepare joint matrices
 		skinObjects = prepareSkinning(model);
+		computeBounds(model);
 
 		// Prepare animation data
 		animationObjects = prepareAnimation(model);
+		compileAnimation(model);
+
+		// Prepare geometry for upload
+		extractGeometry(model);
+		if (optimizeMeshes) {
+			optimizeGeometry();
+		}
+		return true;
+	}
+
+	// Read the cooked file next to path while it matches the glTF file and its buffers;
+	// otherwise parse the glTF file and cook it for the next launch. Does not touch GL.
+	bool load(const char *path) {
+		filename = path;
+		std::string cookedPath = GetCookedModelPath(path);
+		if (loadCooked(cookedPath)) {
+			std::cout << "Loaded cooked model: " << cookedPath << std::endl;
+			return true;
+		}
+
+		if (!loadSource(path)) {
+			return false;
+		}
+		if (saveCooked(cookedPath)) {
+			std::cout << "Cooked model: " << cookedPath << std::endl;
+		} else {
+			std::cout << "Failed to write cooked model: " << cookedPath << std::endl;
+		}
+		return true;
+	}
+
+	// The glTF file and the external buffers it names: the cooked file is stale once any changes
+	std::vector<std::string> getSourceFiles(const tinygltf::Model &model, const std::string &path) const {
+		std::vector<std::string> sources(1, path);
+		std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+		for (const tinygltf::Buffer &buffer : model.buffers) {
+			if (!buffer.uri.empty() && buffer.uri.compare(0, 5, "data:") != 0) {
+				sources.push_back(directory + buffer.uri);
+			}
+		}
+		return sources;
+	}
+
+	// Channel as stored in a cooked file, with the sampler pointer as an index
+	struct CookedChannel {
+		int32_t sampler;
+		int32_t path;
+		int32_t targetSlot;
+	};
+
+	// Write everything loadSource extracted, in its in-memory layout. Only the geometry
+	// ranges are kept from the glTF buffers, packed back to back.
+	bool saveCooked(const std::string &cookedPath) const {
+		CookedWriter writer;
+		if (!BeginCookedFile(writer, cookedPath, CookedModelMagic, CookedModelVersion, getSourceFiles(model, filename))) {
+			return false;
+		}
+
+		WriteCookedValue(writer, (int32_t)optimizeMeshes);
+		std::vector<GeometryRange> packedRanges = geometryRanges;
+		size_t packedSize = 0;
+		for (GeometryRange &range : packedRanges) {
+			range.offset = packedSize;
+			packedSize += range.length;
+		}
+		WriteCookedValue(writer, (uint64_t)packedSize);
+		for (const GeometryRange &range : geometryRanges) {
+			WriteCookedBytes(writer, getGeometryBytes() + range.offset, range.length);
+		}
+		WriteCookedArray(writer, packedRanges);
+		WriteCookedArray(writer, attributeLayouts);
+		WriteCookedArray(writer, primitiveLayouts);
+		WriteCookedValue(writer, (uint64_t)perMeshUploadBytes);
+
+		WriteCookedCount(writer, skinObjects.size());
+		for (const SkinObject &skinObject : skinObjects) {
+			WriteCookedArray(writer, skinObject.inverseBindMatrices);
+			WriteCookedArray(writer, skinObject.jointMatrices);
+		}
+		WriteCookedValue(writer, boundsCenter);
+		WriteCookedValue(writer, boundsRadius);
+
+		WriteCookedArray(writer, skeleton.nodes);
+		WriteCookedArray(writer, skeleton.parents);
+		WriteCookedArray(writer, skeleton.depths);
+		WriteCookedArray(writer, skeleton.slotOfNode);
+		WriteCookedArray(writer, jointSlots);
+		WriteCookedValue(writer, (int32_t)restPose.count);
+		for (int c = 0; c < 3; ++c) {
+			WriteCookedArray(writer, restPose.translation[c]);
+			WriteCookedArray(writer, restPose.scale[c]);
+		}
+		for (int c = 0; c < 4; ++c) {
+			WriteCookedArray(writer, restPose.rotation[c]);
+		}
+
+		WriteCookedCount(writer, animationObjects.size());
+		for (const AnimationObject &animationObject : animationObjects) {
+			const std::vector<SamplerObject> &samplers = animationObject.samplers;
+			WriteCookedCount(writer, samplers.size());
+			for (const SamplerObject &sampler : samplers) {
+				WriteCookedArray(writer, sampler.input);
+				WriteCookedArray(writer, sampler.output);
+				WriteCookedValue(writer, (int32_t)sampler.timeline);
+			}
+
+			// Each timeline is the input of the first sampler that reads it
+			std::vector<int32_t> timelineSamplers;
+			for (const std::vector<float> *timeline : animationObject.timelines) {
+				size_t i = 0;
+				while (&samplers[i].input != timeline) {
+					i++;
+				}
+				timelineSamplers.push_back((int32_t)i);
+			}
+			WriteCookedArray(writer, timelineSamplers);
+
+			std::vector<CookedChannel> channels;
+			for (const ChannelObject &channel : animationObject.channels) {
+				CookedChannel cookedChannel = { channel.samplerIndex, channel.path, channel.targetSlot };
+				channels.push_back(cookedChannel);
+			}
+			WriteCookedArray(writer, channels);
+		}
+
+		return FinishCookedFile(writer);
+	}
+
+	// Map a file written by saveCooked; false if it is missing, stale or damaged. The
+	// mapping is kept as the geometry bytes, so geometry is only read when uploaded.
+	bool loadCooked(const std::string &cookedPath) {
+		CookedReader reader;
+		bool loaded = OpenCookedFile(cookedPath, CookedModelMagic, CookedModelVersion, reader) && readCooked(reader);
+		if (loaded) {
+			releaseGeometry();
+			geometryFile = reader.file;
+			reader.file = MappedFile();
+		}
+		CloseCookedFile(reader);
+		return loaded;
+	}
+
+	// Every index is checked against the array it points into before anything follows it
+	bool readCooked(CookedReader &reader) {
+		// Cooked with the other setting of the import stage: cook again
+		if (ReadCookedValue<int32_t>(reader) != (int32_t)optimizeMeshes) {
+			return false;
+		}
+
+		// The geometry stays in the file: the ranges are moved to its place there
+		size_t geometryOffset, geometrySize;
+		SkipCookedArray(reader, 1, geometryOffset, geometrySize);
+		ReadCookedArray(reader, geometryRanges);
+		ReadCookedArray(reader, attributeLayouts);
+		ReadCookedArray(reader, primitiveLayouts);
+		perMeshUploadBytes = (size_t)ReadCookedValue<uint64_t>(reader);
+		for (GeometryRange &range : geometryRanges) {
+			if (range.offset > geometrySize || range.length > geometrySize - range.offset) {
+				return false;
+			}
+			range.offset += geometryOffset;
+		}
+		for (const AttributeLayout &attribute : attributeLayouts) {
+			if (attribute.range < 0 || attribute.range >= (int)geometryRanges.size()) {
+				return false;
+			}
+		}
+		for (const PrimitiveLayout &primitive : primitiveLayouts) {
+			if (primitive.firstAttribute < 0 || primitive.attributeCount < 0 ||
+				primitive.attributeCount > (int)attributeLayouts.size() - primitive.firstAttribute ||
+				primitive.indexRange < 0 || primitive.indexRange >= (int)geometryRanges.size()) {
+				return false;
+			}
+		}
+
+		skinObjects.resize(ReadCookedCount(reader));
+		for (SkinObject &skinObject : skinObjects) {
+			ReadCookedArray(reader, skinObject.inverseBindMatrices);
+			ReadCookedArray(reader, skinObject.jointMatrices);
+			skinObject.globalJointTransforms.resize(skinObject.jointMatrices.size());
+		}
+		boundsCenter = ReadCookedValue<glm::vec3>(reader);
+		boundsRadius = ReadCookedValue<float>(reader);
+
+		ReadCookedArray(reader, skeleton.nodes);
+		ReadCookedArray(reader, skeleton.parents);
+		ReadCookedArray(reader, skeleton.depths);
+		ReadCookedArray(reader, skeleton.slotOfNode);
+		ReadCookedArray(reader, jointSlots);
+		restPose.count = ReadCookedValue<int32_t>(reader);
+		for (int c = 0; c < 3; ++c) {
+			ReadCookedArray(reader, restPose.translation[c]);
+			ReadCookedArray(reader, restPose.scale[c]);
+		}
+		for (int c = 0; c < 4; ++c) {
+			ReadCookedArray(reader, restPose.rotation[c]);
+		}
+		int slotCount = (int)skeleton.nodes.size();
+		size_t paddedSlots = (size_t)((slotCount + 3) & ~3);
+		if (reader.failed || skeleton.parents.size() != (size_t)slotCount || skeleton.depths.size() != (size_t)slotCount ||
+			restPose.count != slotCount) {
+			return false;
+		}
+		for (int slot = 0; slot < slotCount; ++slot) {
+			if (skeleton.parents[slot] >= slot) {
+				return false;
+			}
+		}
+		for (int c = 0; c < 4; ++c) {
+			if (restPose.rotation[c].size() != paddedSlots || (c < 3 && (restPose.translation[c].size() != paddedSlots ||
+																		  restPose.scale[c].size() != paddedSlots))) {
+				return false;
+			}
+		}
+		for (int slot : jointSlots) {
+			if (slot >= slotCount) {
+				return false;
+			}
+		}
+		for (const SkinObject &skinObject : skinObjects) {
+			if (skinObject.inverseBindMatrices.size() != skinObject.jointMatrices.size()) {
+				return false;
+			}
+		}
+		if (!skinObjects.empty() && skinObjects[0].jointMatrices.size() != jointSlots.size()) {
+			return false;
+		}
+
+		// The sampler pointers stay valid because animationObjects is not resized after this
+		animationObjects.resize(ReadCookedCount(reader));
+		maxTimelines = 0;
+		for (AnimationObject &animationObject : animationObjects) {
+			std::vector<SamplerObject> &samplers = animationObject.samplers;
+			samplers.resize(ReadCookedCount(reader));
+			for (SamplerObject &sampler : samplers) {
+				ReadCookedArray(reader, sampler.input);
+				ReadCookedArray(reader, sampler.output);
+				sampler.timeline = ReadCookedValue<int32_t>(reader);
+				if (sampler.input.empty() || sampler.output.size() < sampler.input.size()) {
+					return false;
+				}
+			}
+
+			std::vector<int32_t> timelineSamplers;
+			ReadCookedArray(reader, timelineSamplers);
+			animationObject.timelines.clear();
+			for (int32_t sampler : timelineSamplers) {
+				if (sampler < 0 || sampler >= (int)samplers.size()) {
+					return false;
+				}
+				animationObject.timelines.push_back(&samplers[sampler].input);
+			}
+			for (const SamplerObject &sampler : samplers) {
+				if (sampler.timeline < 0 || sampler.timeline >= (int)timelineSamplers.size() ||
+					samplers[timelineSamplers[sampler.timeline]].input != sampler.input) {
+					return false;
+				}
+			}
+			maxTimelines = std::max(maxTimelines, animationObject.timelines.size());
+
+			std::vector<CookedChannel> channels;
+			ReadCookedArray(reader, channels);
+			animationObject.channels.clear();
+			for (const CookedChannel &channel : channels) {
+				if (channel.sampler < 0 || channel.sampler >= (int)samplers.size() || channel.path < PATH_TRANSLATION ||
+					channel.path > PATH_SCALE || channel.targetSlot < 0 || channel.targetSlot >= slotCount) {
+					return false;
+				}
+				ChannelObject channelObject;
+				channelObject.sampler = &samplers[channel.sampler];
+				channelObject.samplerIndex = channel.sampler;
+				channelObject.path = (ChannelPath)channel.path;
+				channelObject.targetSlot = channel.targetSlot;
+				animationObject.channels.push_back(channelObject);
+			}
+		}
+		if (reader.failed || reader.offset != reader.file.size) {
+			return false;
+		}
+
+		computeLODSlotCounts();
+		return true;
+	}
+
+	// Bound the POSITION accessors of every primitive, whose min and max glTF requires
+	void computeBounds(const tinygltf::Model &model) {
+		boundsCenter = glm::vec3(0.0f);
+		boundsRadius = 0.0f;
+		glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+		for (const tinygltf::Mesh &mesh : model.meshes) {
+			for (const tinygltf::Primitive &primitive : mesh.primitives) {
+				std::map<std::string, int>::const_iterator position = primitive.attributes.find("POSITION");
+				if (position == primitive.attributes.end()) {
+					continue;
+				}
+				const tinygltf::Accessor &accessor = model.accessors[position->second];
+				if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+					minimum = glm::min(minimum, glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]));
+					maximum = glm::max(maximum, glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]));
+				}
+			}
+		}
+		if (minimum.x <= maximum.x) {
+			boundsCenter = 0.5f * (minimum + maximum);
+			boundsRadius = 0.5f * glm::length(maximum - minimum);
+		}
+	}
+
+	// Create the GPU buffers and program; needs the GL context
+	void upload() {
+		// Prepare buffers for rendering
+		drawRecords = bindGeometry();
+		std::cout << "GPU buffers: " << uploadedBytes << " bytes in " << geometryVBOs.size()
+				  << " bufferViews (uploading per mesh used " << perMeshUploadBytes << " bytes)" << std::endl;
+
+		// The GL buffers hold the geometry from here on
+		releaseGeometry();
 
 		// Create and compile our GLSL program from the shaders
 		programID = LoadShadersFromFile("../lab4/shader/bot.vert", "../lab4/shader/bot.frag");
@@ -490,167 +1158,330 @@ struct MyBot {
 		mvpMatrixID = glGetUniformLocation(programID, "MVP");
 		lightPositionID = glGetUniformLocation(programID, "lightPosition");
 		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
-		jointMatricesID = glGetUniformLocation(programID, "jointMatrices");
+		jointPaletteID = glGetUniformLocation(programID, "jointPalette");
+		jointCountID = glGetUniformLocation(programID, "jointCount");
+		paletteOffsetID = glGetUniformLocation(programID, "paletteOffset");
+	}
+
+	const unsigned char *getGeometryBytes() const {
+		return geometryFile.data != NULL ? geometryFile.data : geometryData.data();
 	}
 
-	void bindMesh(std::vector<PrimitiveObject> &primitiveObjects,
-              tinygltf::Model &model, tinygltf::Mesh &mesh) {
+	void releaseGeometry() {
+		std::vector<unsigned char>().swap(geometryData);
+		UnmapFile(geometryFile);
+	}
 
-    std::map<int, GLuint> vbos;
-    for (size_t i = 0; i < model.bufferViews.size(); ++i) {
-        const tinygltf::BufferView &bufferView = model.bufferViews[i];
+	// Where extractGeometry put the glTF buffers and which range each bufferView became
+	struct GeometryExtraction {
+		std::vector<size_t> bufferOffsets;		// Of each buffer in geometryData
+		std::map<int, int> rangeOfBufferView;
+	};
 
-        int target = bufferView.target;
+	// Add a range for a bufferView the first time a primitive reads it
+	int extractBufferView(const tinygltf::Model &model, int bufferViewIndex, GeometryExtraction &extraction) {
+		std::map<int, int>::iterator found = extraction.rangeOfBufferView.find(bufferViewIndex);
+		if (found != extraction.rangeOfBufferView.end()) {
+			return found->second;
+		}
 
-        if (bufferView.target == 0) {
-            continue;
-        }
+		const tinygltf::BufferView &bufferView = model.bufferViews[bufferViewIndex];
+		GeometryRange range = GeometryRange();
+		range.offset = extraction.bufferOffsets[bufferView.buffer] + bufferView.byteOffset;
+		range.length = bufferView.byteLength;
 
-        const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-        GLuint vbo;
-        glGenBuffers(1, &vbo);
-        glBindBuffer(target, vbo);
-        glBufferData(target, bufferView.byteLength,
-                     &buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
+		int rangeIndex = (int)geometryRanges.size();
+		geometryRanges.push_back(range);
+		extraction.rangeOfBufferView[bufferViewIndex] = rangeIndex;
+		return rangeIndex;
+	}
+
+	void extractMesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh,
+                     GeometryExtraction &extraction) {
 
-        vbos[i] = vbo;
+    // Previously every mesh uploaded all vertex and index bufferViews again
+    for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+        if (model.bufferViews[i].target != 0) {
+            perMeshUploadBytes += model.bufferViews[i].byteLength;
+        }
     }
 
     for (size_t i = 0; i < mesh.primitives.size(); ++i) {
 
-        tinygltf::Primitive primitive = mesh.primitives[i];
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+        const tinygltf::Primitive &primitive = mesh.primitives[i];
+        const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
 
-        GLuint vao;
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
+        PrimitiveLayout primitiveLayout = PrimitiveLayout();
+        primitiveLayout.firstAttribute = (int)attributeLayouts.size();
 
         for (auto &attrib : primitive.attributes) {
-            tinygltf::Accessor accessor = model.accessors[attrib.second];
-            int byteStride =
-                accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-            glBindBuffer(GL_ARRAY_BUFFER, vbos[accessor.bufferView]);
-
-            int size = 1;
-            if (accessor.type != TINYGLTF_TYPE_SCALAR) {
-                size = accessor.type;
-            }
+            const tinygltf::Accessor &accessor = model.accessors[attrib.second];
 
+            AttributeLayout attributeLayout = AttributeLayout();
             if (attrib.first.compare("POSITION") == 0) {
-                int vaa = 0;
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                                      accessor.normalized ? GL_TRUE : GL_FALSE,
-                                      byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                attributeLayout.location = 0;
             } else if (attrib.first.compare("NORMAL") == 0) {
-                int vaa = 1;
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                                      accessor.normalized ? GL_TRUE : GL_FALSE,
-                                      byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                attributeLayout.location = 1;
             } else if (attrib.first.compare("TEXCOORD_0") == 0) {
-                int vaa = 2;
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                                      accessor.normalized ? GL_TRUE : GL_FALSE,
-                                      byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                attributeLayout.location = 2;
             } else if (attrib.first.compare("JOINTS_0") == 0) {
-                int vaa = 3; // Attribute location for JOINTS_0
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribIPointer(vaa, size, accessor.componentType,
-                                       byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                attributeLayout.location = 3; // Attribute location for JOINTS_0
+                attributeLayout.integer = GL_TRUE;
             } else if (attrib.first.compare("WEIGHTS_0") == 0) {
-                int vaa = 4; // Attribute location for WEIGHTS_0
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                                      accessor.normalized ? GL_TRUE : GL_FALSE,
-                                      byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                attributeLayout.location = 4; // Attribute location for WEIGHTS_0
             } else {
                 std::cout << "Unrecognized attribute: " << attrib.first << std::endl;
+                continue;
             }
-        }
-
-        // Record VAO for later use
-        PrimitiveObject primitiveObject;
-        primitiveObject.vao = vao;
-        primitiveObject.vbos = vbos;
-        primitiveObjects.push_back(primitiveObject);
 
-        glBindVertexArray(0);
+            attributeLayout.size = 1;
+            if (accessor.type != TINYGLTF_TYPE_SCALAR) {
+                attributeLayout.size = accessor.type;
+            }
+            attributeLayout.componentType = accessor.componentType;
+            attributeLayout.normalized = accessor.normalized ? GL_TRUE : GL_FALSE;
+            attributeLayout.stride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+            attributeLayout.offset = accessor.byteOffset;
+            attributeLayout.range = extractBufferView(model, accessor.bufferView, extraction);
+            attributeLayouts.push_back(attributeLayout);
+        }
+        primitiveLayout.attributeCount = (int)attributeLayouts.size() - primitiveLayout.firstAttribute;
+
+        // Record everything the draw call needs
+        primitiveLayout.indexRange = extractBufferView(model, indexAccessor.bufferView, extraction);
+        primitiveLayout.mode = primitive.mode;
+        primitiveLayout.count = (GLsizei)indexAccessor.count;
+        primitiveLayout.indexType = indexAccessor.componentType;
+        primitiveLayout.indexOffset = indexAccessor.byteOffset;
+        primitiveLayout.material = primitive.material;
+        primitiveLayouts.push_back(primitiveLayout);
     }
 }
 
 
-	void bindModelNodes(std::vector<PrimitiveObject> &primitiveObjects,
-						tinygltf::Model &model,
-						tinygltf::Node &node) {
-		// Bind buffers for the current mesh at the node
+	void extractModelNodes(const tinygltf::Model &model,
+						   const tinygltf::Node &node,
+						   GeometryExtraction &extraction) {
+		// Extract the mesh at the node
 		if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-			bindMesh(primitiveObjects, model, model.meshes[node.mesh]);
+			extractMesh(model, model.meshes[node.mesh], extraction);
 		}
 
 		// Recursive into children nodes
 		for (size_t i = 0; i < node.children.size(); i++) {
 			assert((node.children[i] >= 0) && (node.children[i] < model.nodes.size()));
-			bindModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+			extractModelNodes(model, model.nodes[node.children[i]], extraction);
 		}
 	}
 
-	std::vector<PrimitiveObject> bindModel(tinygltf::Model &model) {
-		std::vector<PrimitiveObject> primitiveObjects;
+	// Take over the glTF buffers as the geometry bytes instead of copying them: a single
+	// buffer is swapped in whole, several are appended and freed one at a time. Skinning and
+	// animation data must be extracted first, since the model's buffers are empty afterwards.
+	void extractGeometry(tinygltf::Model &model) {
+		releaseGeometry();
+		geometryRanges.clear();
+		attributeLayouts.clear();
+		primitiveLayouts.clear();
+		perMeshUploadBytes = 0;
+
+		GeometryExtraction extraction;
+		for (size_t i = 0; i < model.buffers.size(); ++i) {
+			std::vector<unsigned char> &data = model.buffers[i].data;
+			extraction.bufferOffsets.push_back(geometryData.size());
+			if (geometryData.empty()) {
+				geometryData.swap(data);
+			} else {
+				geometryData.insert(geometryData.end(), data.begin(), data.end());
+			}
+			std::vector<unsigned char>().swap(data);
+		}
 
 		const tinygltf::Scene &scene = model.scenes[model.defaultScene];
 		for (size_t i = 0; i < scene.nodes.size(); ++i) {
 			assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
-			bindModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
+			extractModelNodes(model, model.nodes[scene.nodes[i]], extraction);
 		}
+	}
+
+	// Rebuild the geometry bytes with each indexed triangle primitive run through OptimizeMesh:
+	// its attributes interleaved into one range and its indices into another, 16-bit where
+	// they fit. Other primitives keep a copy of their ranges as they are.
+	void optimizeGeometry() {
+		const unsigned char *bytes = getGeometryBytes();
+		std::vector<unsigned char> optimizedData;
+		std::vector<GeometryRange> optimizedRanges;
+		std::vector<int> copiedRanges(geometryRanges.size(), -1);
+		auto appendRange = [&optimizedData, &optimizedRanges](const unsigned char *data, size_t length) {
+			GeometryRange range;
+			range.offset = (optimizedData.size() + 3) & ~(size_t)3;
+			range.length = length;
+			optimizedData.resize(range.offset);
+			optimizedData.insert(optimizedData.end(), data, data + length);
+			optimizedRanges.push_back(range);
+			return (int)optimizedRanges.size() - 1;
+		};
+		auto copyRange = [&](int range) {
+			if (copiedRanges[range] < 0) {
+				copiedRanges[range] = appendRange(bytes + geometryRanges[range].offset, geometryRanges[range].length);
+			}
+			return copiedRanges[range];
+		};
+
+		size_t sourceBytes = 0;
+		for (const GeometryRange &range : geometryRanges) {
+			sourceBytes += range.length;
+		}
+		size_t triangles = 0, sourceMisses = 0, misses = 0, sourceVertices = 0, vertices = 0;
+		std::vector<uint32_t> indices;
+		std::vector<MeshStream> streams;
+		for (PrimitiveLayout &primitive : primitiveLayouts) {
+			AttributeLayout *attributes = &attributeLayouts[primitive.firstAttribute];
+			const GeometryRange &indexRange = geometryRanges[primitive.indexRange];
+			size_t indexSize = tinygltf::GetComponentSizeInBytes(primitive.indexType);
+			bool optimizable = primitive.mode == GL_TRIANGLES && primitive.count >= 3 &&
+				(primitive.indexType == GL_UNSIGNED_BYTE || primitive.indexType == GL_UNSIGNED_SHORT ||
+				 primitive.indexType == GL_UNSIGNED_INT) && primitive.indexOffset <= indexRange.length &&
+				primitive.count * indexSize <= indexRange.length - primitive.indexOffset;
+			if (optimizable) {
+				UnpackIndices(bytes + indexRange.offset + primitive.indexOffset, primitive.count, indexSize, indices);
+			}
+			size_t vertexCount = 0;
+			for (size_t i = 0; optimizable && i < indices.size(); ++i) {
+				vertexCount = std::max(vertexCount, (size_t)indices[i] + 1);
+			}
 
-		return primitiveObjects;
+			// Every stream must hold the vertices the indices reach
+			int positionStream = -1;
+			streams.clear();
+			for (int a = 0; optimizable && a < primitive.attributeCount; ++a) {
+				const AttributeLayout &attribute = attributes[a];
+				const GeometryRange &range = geometryRanges[attribute.range];
+				int componentSize = tinygltf::GetComponentSizeInBytes(attribute.componentType);
+				MeshStream stream;
+				stream.size = attribute.size * std::max(componentSize, 0);
+				stream.stride = attribute.stride != 0 ? attribute.stride : stream.size;
+				stream.data = bytes + range.offset + attribute.offset;
+				optimizable = componentSize > 0 && attribute.offset <= range.length &&
+					(vertexCount - 1) * stream.stride + stream.size <= range.length - attribute.offset;
+				if (attribute.location == 0 && attribute.componentType == GL_FLOAT && attribute.size == 3) {
+					positionStream = a;
+				}
+				streams.push_back(stream);
+			}
+
+			if (!optimizable) {
+				for (int a = 0; a < primitive.attributeCount; ++a) {
+					attributes[a].range = copyRange(attributes[a].range);
+				}
+				primitive.indexRange = copyRange(primitive.indexRange);
+				continue;
+			}
+
+			OptimizedMesh mesh;
+			OptimizeMesh(indices, streams.data(), streams.size(), positionStream, mesh);
+			int vertexRange = appendRange(mesh.vertices.data(), mesh.vertices.size());
+			for (int a = 0; a < primitive.attributeCount; ++a) {
+				attributes[a].range = vertexRange;
+				attributes[a].offset = mesh.streamOffsets[a];
+				attributes[a].stride = (GLsizei)mesh.vertexSize;
+			}
+			primitive.indexRange = appendRange(mesh.indices.data(), mesh.indices.size());
+			primitive.indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			primitive.indexOffset = 0;
+
+			triangles += mesh.indexCount / 3;
+			sourceMisses += mesh.sourceCacheMisses;
+			misses += mesh.cacheMisses;
+			sourceVertices += mesh.sourceVertexCount;
+			vertices += mesh.vertexCount;
+		}
+
+		releaseGeometry();
+		geometryData.swap(optimizedData);
+		geometryRanges.swap(optimizedRanges);
+
+		if (triangles > 0 && !quiet) {
+			std::cout << std::fixed << std::setprecision(2) << "Optimized meshes: ACMR "
+					  << (float)sourceMisses / triangles << " -> " << (float)misses / triangles << ", "
+					  << sourceVertices << " -> " << vertices << " vertices, " << sourceBytes << " -> "
+					  << geometryData.size() << " bytes" << std::endl;
+		}
 	}
 
-	void drawMesh(const std::vector<PrimitiveObject> &primitiveObjects,
-				tinygltf::Model &model, tinygltf::Mesh &mesh) {
+	// Upload every geometry range once and build the VAO of each primitive from its layout
+	std::vector<DrawRecord> bindGeometry() {
+		std::vector<DrawRecord> drawRecords;
 
-		for (size_t i = 0; i < mesh.primitives.size(); ++i)
-		{
-			GLuint vao = primitiveObjects[i].vao;
-			std::map<int, GLuint> vbos = primitiveObjects[i].vbos;
+		// Index ranges are bound to GL_ELEMENT_ARRAY_BUFFER once a VAO is bound to record them
+		geometryVBOs.resize(geometryRanges.size());
+		for (size_t i = 0; i < geometryRanges.size(); ++i) {
+			const GeometryRange &range = geometryRanges[i];
+			geometryVBOs[i] = UploadStaticBuffer(uploadStaging, getGeometryBytes() + range.offset, range.length);
+			uploadedBytes += range.length;
+		}
 
+		for (size_t i = 0; i < primitiveLayouts.size(); ++i) {
+			const PrimitiveLayout &primitive = primitiveLayouts[i];
+
+			GLuint vao;
+			glGenVertexArrays(1, &vao);
 			glBindVertexArray(vao);
 
-			tinygltf::Primitive primitive = mesh.primitives[i];
-			tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+			for (int a = 0; a < primitive.attributeCount; ++a) {
+				const AttributeLayout &attribute = attributeLayouts[primitive.firstAttribute + a];
+				glBindBuffer(GL_ARRAY_BUFFER, geometryVBOs[attribute.range]);
+				glEnableVertexAttribArray(attribute.location);
+				if (attribute.integer) {
+					glVertexAttribIPointer(attribute.location, attribute.size, attribute.componentType,
+										   attribute.stride, BUFFER_OFFSET(attribute.offset));
+				} else {
+					glVertexAttribPointer(attribute.location, attribute.size, attribute.componentType,
+										  attribute.normalized, attribute.stride, BUFFER_OFFSET(attribute.offset));
+				}
+			}
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
+			// Bind the indices while the VAO is bound so the VAO records them
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometryVBOs[primitive.indexRange]);
 
-			glDrawElements(primitive.mode, indexAccessor.count,
-						indexAccessor.componentType,
-						BUFFER_OFFSET(indexAccessor.byteOffset));
+			DrawRecord drawRecord;
+			drawRecord.vao = vao;
+			drawRecord.mode = primitive.mode;
+			drawRecord.count = primitive.count;
+			drawRecord.indexType = primitive.indexType;
+			drawRecord.indexOffset = primitive.indexOffset;
+			drawRecord.material = primitive.material;
+			drawRecords.push_back(drawRecord);
 
 			glBindVertexArray(0);
 		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		return drawRecords;
 	}
 
-	void drawModelNodes(const std::vector<PrimitiveObject>& primitiveObjects,
-						tinygltf::Model &model, tinygltf::Node &node) {
-		// Draw the mesh at the node, and recursively do so for children nodes
-		if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-			drawMesh(primitiveObjects, model, model.meshes[node.mesh]);
-		}
-		for (size_t i = 0; i < node.children.size(); i++) {
-			drawModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+	void drawModel(const std::vector<DrawRecord> &drawRecords, GLsizei instanceCount) {
+		// Draw every primitive for all instances, switching VAO only when it changes
+		GLuint boundVAO = 0;
+		for (size_t i = 0; i < drawRecords.size(); ++i) {
+			const DrawRecord &drawRecord = drawRecords[i];
+			if (drawRecord.vao != boundVAO) {
+				glBindVertexArray(drawRecord.vao);
+				boundVAO = drawRecord.vao;
+			}
+			glDrawElementsInstanced(drawRecord.mode, drawRecord.count, drawRecord.indexType,
+									BUFFER_OFFSET(drawRecord.indexOffset), instanceCount);
 		}
+		glBindVertexArray(0);
 	}
-	void drawModel(const std::vector<PrimitiveObject>& primitiveObjects,
-				tinygltf::Model &model) {
-		// Draw all nodes
-		const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-		for (size_t i = 0; i < scene.nodes.size(); ++i) {
-			drawModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
-		}
+
+	// Number of joint matrices each instance stores in the palette
+	int getJointCount() const {
+		return skinObjects.empty() ? 0 : (int)skinObjects[0].jointMatrices.size();
 	}
 
-	void render(glm::mat4 cameraMatrix) {
+	// Draw instanceCount instances whose joint matrices sit back to back in the palette from
+	// paletteOffset. The matrices carry each instance's world transform.
+	void renderInstances(const glm::mat4 &cameraMatrix, const JointPalette &palette, int paletteOffset, int instanceCount) {
 		glUseProgram(programID);
 
 		// Set camera
@@ -661,7 +1492,10 @@ struct MyBot {
 		// TODO: Set animation data for linear blend skinning in shader
 		// -----------------------------------------------------------------
 
-		glUniformMatrix4fv(jointMatricesID, skinObjects[0].jointMatrices.size(), GL_FALSE, glm::value_ptr(skinObjects[0].jointMatrices[0]));
+		BindJointPalette(palette, 0);
+		glUniform1i(jointPaletteID, 0);
+		glUniform1i(jointCountID, getJointCount());
+		glUniform1i(paletteOffsetID, paletteOffset);
 
 		// -----------------------------------------------------------------
 
@@ -670,15 +1504,687 @@ struct MyBot {
 		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
 
 		// Draw the GLTF model
-		drawModel(primitiveObjects, model);
+		drawModel(drawRecords, instanceCount);
+	}
+
+	// Draw instanceCount instances posed entirely on the GPU from the baked clip. Each instance
+	// record is its world transform with the bottom row replaced by (start time, speed, 0, 1);
+	// time is the seconds elapsed since the records were written.
+	void renderBaked(const glm::mat4 &cameraMatrix, const JointPalette &instanceRecords, int instanceCount, float time) {
+		glUseProgram(bakedProgramID);
+		glUniformMatrix4fv(bakedMvpMatrixID, 1, GL_FALSE, &cameraMatrix[0][0]);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, bakedAnimation.textureID);
+		glUniform1i(bakedPoseID, 0);
+		BindJointPalette(instanceRecords, 1);
+		glUniform1i(instanceRecordsID, 1);
+		glUniform1f(bakedTimeID, time);
+		glUniform1f(bakedLoopStartTimeID, bakedAnimation.startTime);
+		glUniform1f(bakedFrameRateID, bakedAnimation.frameRate);
+		glUniform1i(bakedFrameCountID, bakedAnimation.frameCount);
+
+		glUniform3fv(bakedLightPositionID, 1, &lightPosition[0]);
+		glUniform3fv(bakedLightIntensityID, 1, &lightIntensity[0]);
+
+		drawModel(drawRecords, instanceCount);
 	}
 
 	void cleanup() {
+		for (size_t i = 0; i < drawRecords.size(); ++i) {
+			glDeleteVertexArrays(1, &drawRecords[i].vao);
+		}
+		if (!geometryVBOs.empty()) {
+			glDeleteBuffers((GLsizei)geometryVBOs.size(), geometryVBOs.data());
+		}
+		geometryVBOs.clear();
+		releaseGeometry();
 		glDeleteProgram(programID);
+		if (bakedAnimation.textureID != 0) {
+			DestroyBakedAnimation(bakedAnimation);
+			glDeleteProgram(bakedProgramID);
+		}
 	}
 };
 
-int main(void)
+// Loaded and loading assets by file name
+static std::map<std::string, ModelAsset*> modelAssets;
+
+// Runs on the GL thread once a worker finished loading asset
+static void FinishModelAssetLoad(ModelAsset *asset, bool loaded)
+{
+	asset->loading = false;
+	if (loaded && asset->refCount > 0) {
+		asset->upload();
+		return;
+	}
+
+	// Failed, or released while loading: nothing reached the GPU, so only the CPU side is freed
+	modelAssets.erase(asset->filename);
+	asset->failed = !loaded;
+	asset->releaseGeometry();
+	if (asset->refCount == 0) {
+		delete asset;
+	}
+}
+
+// Start loading a file on a background job on first use; later calls share the same
+// asset. The GL thread uploads it from RunMainThreadTasks, after which loading is false.
+// Check failed before drawing it, and release it either way.
+static ModelAsset *RequestModelAsset(const char *filename)
+{
+	std::map<std::string, ModelAsset*>::iterator found = modelAssets.find(filename);
+	if (found != modelAssets.end()) {
+		found->second->refCount++;
+		return found->second;
+	}
+
+	ModelAsset *asset = new ModelAsset();
+	asset->refCount = 1;
+	asset->loading = true;
+	modelAssets[filename] = asset;
+
+	// The worker owns everything but refCount, loading and failed until it posts the result
+	std::string path = filename;
+	SubmitBackgroundJob([asset, path]() {
+		bool loaded = asset->load(path.c_str());
+		PostMainThreadTask([asset, loaded]() { FinishModelAssetLoad(asset, loaded); });
+	});
+	return asset;
+}
+
+static void ReleaseModelAsset(ModelAsset *asset)
+{
+	// A load still in flight deletes the asset when it finishes
+	if (--asset->refCount > 0 || asset->loading) {
+		return;
+	}
+
+	// Free the GPU buffers once the last instance lets go
+	if (!asset->failed) {
+		modelAssets.erase(asset->filename);
+		asset->cleanup();
+	}
+	delete asset;
+}
+
+// Load and upload a file on first use, waiting for it; later calls share the same asset
+static ModelAsset *AcquireModelAsset(const char *filename)
+{
+	ModelAsset *asset = RequestModelAsset(filename);
+	while (asset->loading) {
+		if (RunMainThreadTasks(1) == 0) {
+			std::this_thread::yield();
+		}
+	}
+	if (asset->failed) {
+		ReleaseModelAsset(asset);
+		return NULL;
+	}
+	return asset;
+}
+
+// One animated character: its playback clock, pose buffers and joint matrices.
+// Everything else comes from the shared ModelAsset, so spawning an instance only sizes
+// the pose buffers.
+struct ModelInstance {
+	ModelAsset *asset = NULL;
+
+	float time = 0.0f;			 // Playback time of the last update
+	float speed = 1.0f;			 // Playback rate used by advance
+	float loopStartTime = 0.5f;  // Start of the loop segment
+	float loopEndTime = 2.5f;    // End of the loop segment
+	bool useLooping = true;      // Flag to enable/disable custom looping
+	glm::mat4 worldTransform = glm::mat4(1.0f);
+
+	ModelAsset::AnimationState animationState;
+	std::vector<glm::mat4> jointMatrices;	// Skin 0, including worldTransform
+
+	// Level of detail state: reduced tiers blend from the previous to the latest evaluated pose
+	int lod = -1;							// -1 until the first advance
+	int framesSinceUpdate = 0;
+	std::vector<glm::mat4> previousJointMatrices;
+	std::vector<glm::mat4> targetJointMatrices;
+
+	bool initialize(const char *filename) {
+		asset = AcquireModelAsset(filename);
+		if (asset == NULL) {
+			return false;
+		}
+		asset->initAnimationState(animationState);
+		if (!asset->skinObjects.empty()) {
+			jointMatrices = asset->skinObjects[0].jointMatrices;
+		}
+		previousJointMatrices = jointMatrices;
+		targetJointMatrices = jointMatrices;
+		return true;
+	}
+
+	// Heap memory owned by this instance
+	size_t instanceBytes() const {
+		const ModelAsset::AnimationState &state = animationState;
+		size_t bytes = (jointMatrices.capacity() + previousJointMatrices.capacity() + targetJointMatrices.capacity()) * sizeof(glm::mat4);
+		bytes += (state.localTransforms.capacity() + state.globalTransforms.capacity()) * sizeof(glm::mat4);
+		bytes += state.cursors.capacity() * sizeof(KeyframeCursor) + state.lookups.capacity() * sizeof(KeyframeLookup);
+		for (int c = 0; c < 4; ++c) {
+			bytes += state.pose.rotation[c].capacity() * sizeof(float);
+		}
+		for (int c = 0; c < 3; ++c) {
+			bytes += (state.pose.translation[c].capacity() + state.pose.scale[c].capacity()) * sizeof(float);
+		}
+		return bytes;
+	}
+
+	// Map the playback time onto the looped segment of the animation
+	float getAnimationTime(float time) const {
+		if (!useLooping) {
+			// Default behavior - use full animation duration
+			return time;
+		}
+		// If current time is before loop start, reset to loop start
+		if (time < loopStartTime) {
+			return loopStartTime;
+		}
+		// If current time is past loop end, wrap back to loop start
+		if (time > loopEndTime) {
+			return loopStartTime + fmod(time - loopEndTime, loopEndTime - loopStartTime);
+		}
+		// Otherwise, use the current time
+		return time;
+	}
+
+	// Evaluate the pose at the current time into out, animating activeSlots skeleton slots
+	void evaluatePose(int activeSlots, std::vector<glm::mat4> &out) {
+		if (!asset->animationObjects.empty()) {
+			// Update node transforms with animation data
+			asset->evaluateAnimation(asset->animationObjects[0], getAnimationTime(time), animationState, activeSlots);
+
+			// Update skinning
+			asset->computeJointMatrices(animationState, asset->skinObjects[0], worldTransform, out);
+		}
+	}
+
+	// Pose the instance at an absolute playback time, at full detail
+	void update(float playbackTime) {
+		time = playbackTime;
+		evaluatePose((int)asset->skeleton.nodes.size(), jointMatrices);
+	}
+
+	// Projected height of the bounding sphere as a fraction of the viewport height, or 0 when
+	// the sphere is outside the view frustum so off-screen instances take the cheapest tier
+	float getScreenSize(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix) const {
+		glm::vec4 center = viewMatrix * worldTransform * glm::vec4(asset->boundsCenter, 1.0f);
+
+		// Frustum planes in view space are sums and differences of the projection's rows
+		glm::vec4 w(projectionMatrix[0][3], projectionMatrix[1][3], projectionMatrix[2][3], projectionMatrix[3][3]);
+		for (int axis = 0; axis < 3; ++axis) {
+			glm::vec4 row(projectionMatrix[0][axis], projectionMatrix[1][axis], projectionMatrix[2][axis], projectionMatrix[3][axis]);
+			for (int side = -1; side <= 1; side += 2) {
+				glm::vec4 plane = w + (float)side * row;
+				float offset = glm::dot(plane, center) / glm::length(glm::vec3(plane));
+				if (offset < -asset->boundsRadius) {
+					return 0.0f;
+				}
+			}
+		}
+
+		float distance = std::max(-center.z, 1e-3f);
+		return asset->boundsRadius * projectionMatrix[1][1] / distance;
+	}
+
+	// Tier for a projected size: the first whose minimum size it reaches
+	static int selectLOD(float screenSize) {
+		int level = 0;
+		while (level < AnimationLODCount - 1 && screenSize < animationLODs[level].minScreenSize) {
+			level++;
+		}
+		return level;
+	}
+
+	// Move the playback time on by deltaTime at this instance's speed and refresh the pose at
+	// the given level of detail. Tiers with an update interval above one evaluate every few
+	// frames and blend between their last two poses, which shows each pose one interval late.
+	void advance(float deltaTime, int level) {
+		time += deltaTime * speed;
+		const AnimationLOD &tier = animationLODs[level];
+		int activeSlots = asset->lodSlotCounts[level];
+		bool tierChanged = level != lod;
+		lod = level;
+
+		// Hold the pose, evaluating only on entering the tier
+		if (tier.updateInterval == 0) {
+			if (tierChanged) {
+				evaluatePose(activeSlots, jointMatrices);
+			}
+			return;
+		}
+
+		if (tierChanged || ++framesSinceUpdate >= tier.updateInterval) {
+			if (tierChanged) {
+				// Blend on from what is on screen now
+				previousJointMatrices = jointMatrices;
+			} else {
+				previousJointMatrices.swap(targetJointMatrices);
+			}
+			evaluatePose(activeSlots, targetJointMatrices);
+			framesSinceUpdate = 0;
+		}
+
+		float blend = (framesSinceUpdate + 1) / (float)tier.updateInterval;
+		if (blend >= 1.0f) {
+			jointMatrices = targetJointMatrices;
+			return;
+		}
+		for (size_t i = 0; i < jointMatrices.size(); ++i) {
+			jointMatrices[i] = previousJointMatrices[i] * (1.0f - blend) + targetJointMatrices[i] * blend;
+		}
+	}
+
+	// Original update with its per-frame allocations, kept as the benchmark reference
+	void updateReference(float playbackTime) {
+		time = playbackTime;
+		asset->evaluateReference(getAnimationTime(time), worldTransform, jointMatrices);
+	}
+
+	void render(const glm::mat4 &cameraMatrix, JointPalette &palette) {
+		glm::mat4 *paletteMatrices = MapJointPalette(palette, jointMatrices.size());
+		if (paletteMatrices == NULL) {
+			return;
+		}
+		memcpy(paletteMatrices, jointMatrices.data(), jointMatrices.size() * sizeof(glm::mat4));
+		UnmapJointPalette(palette);
+		asset->renderInstances(cameraMatrix, palette, 0, 1);
+	}
+
+	void cleanup() {
+		if (asset != NULL) {
+			ReleaseModelAsset(asset);
+			asset = NULL;
+		}
+	}
+};
+
+// Many instances of one model asset, each playing the first animation with its own clock.
+// Instances only write their own pose buffers, so updates run in parallel on the job system.
+struct CrowdAnimator {
+	std::vector<ModelInstance> instances;
+	int lodCounts[AnimationLODCount];		// Instances in each tier after the last update
+
+	// Baked mode: the GPU poses every instance from the asset's baked clip, so an update
+	// only advances bakedClock
+	bool useBaked = false;
+	float bakedClock = 0.0f;				// Seconds since instanceRecords were written
+	JointPalette instanceRecords = JointPalette();
+
+	// Place count instances on a grid in front of the origin, with varied phase and speed
+	bool initialize(const char *filename, int count, float spacing) {
+		for (int level = 0; level < AnimationLODCount; ++level) {
+			lodCounts[level] = 0;
+		}
+		instances.resize(count);
+		int columns = (int)ceil(sqrt((double)count));
+		for (int i = 0; i < count; ++i) {
+			ModelInstance &instance = instances[i];
+			if (!instance.initialize(filename)) {
+				instances.resize(i);
+				return false;
+			}
+			instance.time = instance.loopStartTime + (i * 0.37f);
+			instance.speed = 0.8f + 0.4f * ((i * 7) % 11) / 10.0f;
+
+			float x = ((i % columns) - 0.5f * (columns - 1)) * spacing;
+			float z = -(i / columns) * spacing;
+			instance.worldTransform = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+		}
+		return true;
+	}
+
+	// Switch between CPU and baked animation. Entering baked mode bakes the clip on first use
+	// and records each instance's playback state; leaving it carries the elapsed time back.
+	bool setBaked(bool enabled) {
+		if (enabled == useBaked || instances.empty()) {
+			return useBaked;
+		}
+
+		if (!enabled) {
+			for (size_t i = 0; i < instances.size(); ++i) {
+				instances[i].time += bakedClock * instances[i].speed;
+				instances[i].lod = -1;
+			}
+			useBaked = false;
+			return false;
+		}
+
+		// The baked shader reads every instance record from one palette
+		if (instances.size() > GetJointPaletteLimit()) {
+			std::cout << "Baked crowd needs at most " << GetJointPaletteLimit() << " bots, staying on the CPU" << std::endl;
+			return false;
+		}
+
+		// Every instance shares the loop window of the first
+		const ModelInstance &first = instances[0];
+		if (!first.asset->bake(first.loopStartTime, first.loopEndTime, 30.0f)) {
+			return false;
+		}
+		if (instanceRecords.textureID == 0) {
+			instanceRecords = CreateJointPalette(instances.size());
+		}
+		glm::mat4 *records = MapJointPalette(instanceRecords, instances.size());
+		if (records == NULL) {
+			return false;
+		}
+		for (size_t i = 0; i < instances.size(); ++i) {
+			glm::mat4 record = instances[i].worldTransform;
+			record[0][3] = instances[i].time;
+			record[1][3] = instances[i].speed;
+			records[i] = record;
+		}
+		UnmapJointPalette(instanceRecords);
+		bakedClock = 0.0f;
+		useBaked = true;
+		return true;
+	}
+
+	// Advance every instance, choosing its level of detail from its size on screen
+	void update(float deltaTime, const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix) {
+		if (useBaked) {
+			bakedClock += deltaTime;
+			return;
+		}
+
+		std::vector<ModelInstance> &crowd = instances;
+		bool useLOD = useAnimationLOD;
+		ParallelFor((int)crowd.size(), 16, [&crowd, &viewMatrix, &projectionMatrix, deltaTime, useLOD](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				ModelInstance &instance = crowd[i];
+				int level = useLOD ? ModelInstance::selectLOD(instance.getScreenSize(viewMatrix, projectionMatrix)) : 0;
+				instance.advance(deltaTime, level);
+			}
+		});
+
+		for (int level = 0; level < AnimationLODCount; ++level) {
+			lodCounts[level] = 0;
+		}
+		for (size_t i = 0; i < instances.size(); ++i) {
+			lodCounts[instances[i].lod]++;
+		}
+	}
+
+	// Instances drawn by one instanced draw, as many as the palette can hold
+	size_t getInstancesPerDraw() const {
+		size_t jointCount = instances.empty() ? 0 : instances[0].asset->getJointCount();
+		return jointCount > 0 ? std::max((size_t)1, GetJointPaletteLimit() / jointCount) : instances.size();
+	}
+
+	// Every instance shares one asset, so the crowd is one instanced draw per primitive for
+	// each batch of instances that fits in the palette
+	void render(const glm::mat4 &cameraMatrix, JointPalette &palette) {
+		if (instances.empty()) {
+			return;
+		}
+		ModelAsset *asset = instances[0].asset;
+		if (useBaked) {
+			asset->renderBaked(cameraMatrix, instanceRecords, (int)instances.size(), bakedClock);
+			return;
+		}
+
+		size_t jointCount = asset->getJointCount();
+		size_t instancesPerDraw = getInstancesPerDraw();
+		for (size_t first = 0; first < instances.size(); first += instancesPerDraw) {
+			size_t count = std::min(instancesPerDraw, instances.size() - first);
+			glm::mat4 *paletteMatrices = MapJointPalette(palette, count * jointCount);
+			if (paletteMatrices == NULL) {
+				return;
+			}
+			for (size_t i = 0; i < count; ++i) {
+				memcpy(paletteMatrices + i * jointCount, instances[first + i].jointMatrices.data(), jointCount * sizeof(glm::mat4));
+			}
+			UnmapJointPalette(palette);
+			asset->renderInstances(cameraMatrix, palette, 0, (int)count);
+		}
+	}
+
+	void cleanup() {
+		if (instanceRecords.textureID != 0) {
+			DestroyJointPalette(instanceRecords);
+		}
+		for (size_t i = 0; i < instances.size(); ++i) {
+			instances[i].cleanup();
+		}
+		instances.clear();
+	}
+};
+
+// Evaluations per second of the original and the compiled animation update
+static void RunAnimationBenchmark(ModelInstance &bot)
+{
+	if (bot.asset->animationObjects.empty()) {
+		std::cout << "Benchmark: model has no animation" << std::endl;
+		return;
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	const int evaluations = 20000;
+	const float timeStep = 0.0137f;
+
+	// Load of the glTF file against its cooked file, best of a few runs with the files cached
+	const char *path = bot.asset->filename.c_str();
+	const int loads = 5;
+	ModelAsset sourceAsset;
+	double sourceLoadTime = DBL_MAX, cookedLoadTime = DBL_MAX;
+	bool cooked = true;
+	for (int i = 0; i < loads; ++i) {
+		sourceAsset = ModelAsset();
+		sourceAsset.quiet = true;
+		Clock::time_point start = Clock::now();
+		sourceAsset.loadSource(path);
+		sourceLoadTime = std::min(sourceLoadTime, std::chrono::duration<double>(Clock::now() - start).count());
+	}
+	for (int i = 0; i < loads; ++i) {
+		ModelAsset cookedAsset;
+		cookedAsset.quiet = true;
+		Clock::time_point start = Clock::now();
+		cooked = cookedAsset.loadCooked(GetCookedModelPath(path)) && cooked;
+		cookedLoadTime = std::min(cookedLoadTime, std::chrono::duration<double>(Clock::now() - start).count());
+		cookedAsset.releaseGeometry();
+	}
+	std::cout << std::fixed << std::setprecision(2) << "Load: glTF " << sourceLoadTime * 1000.0 << " ms";
+	if (cooked) {
+		std::cout << ", cooked " << cookedLoadTime * 1000.0 << " ms (" << sourceLoadTime / cookedLoadTime << "x)" << std::endl;
+	} else {
+		std::cout << ", no current cooked file" << std::endl;
+	}
+
+	// Several glTF files parsed at once by background jobs against one after another, each
+	// result handed back through the main thread tasks as RequestModelAsset does. Best of
+	// two rounds, so neither side pays for touching fresh memory.
+	const int parallelLoads = 8;
+	double serialLoadTime = DBL_MAX, parallelLoadTime = DBL_MAX;
+	for (int round = 0; round < 2; ++round) {
+		std::vector<ModelAsset> serialAssets(parallelLoads);
+		for (int i = 0; i < parallelLoads; ++i) {
+			serialAssets[i].quiet = true;
+		}
+		Clock::time_point loadStart = Clock::now();
+		for (int i = 0; i < parallelLoads; ++i) {
+			serialAssets[i].loadSource(path);
+		}
+		serialLoadTime = std::min(serialLoadTime, std::chrono::duration<double>(Clock::now() - loadStart).count());
+		serialAssets.clear();
+
+		std::vector<ModelAsset> parallelAssets(parallelLoads);
+		for (int i = 0; i < parallelLoads; ++i) {
+			parallelAssets[i].quiet = true;
+		}
+		int finishedLoads = 0;
+		loadStart = Clock::now();
+		for (int i = 0; i < parallelLoads; ++i) {
+			ModelAsset *asset = &parallelAssets[i];
+			std::string assetPath = path;
+			SubmitBackgroundJob([asset, assetPath, &finishedLoads]() {
+				asset->loadSource(assetPath.c_str());
+				PostMainThreadTask([&finishedLoads]() { finishedLoads++; });
+			});
+		}
+		while (finishedLoads < parallelLoads) {
+			if (RunMainThreadTasks(parallelLoads) == 0) {
+				std::this_thread::yield();
+			}
+		}
+		parallelLoadTime = std::min(parallelLoadTime, std::chrono::duration<double>(Clock::now() - loadStart).count());
+	}
+	std::cout << "Load of " << parallelLoads << " files: serial " << serialLoadTime * 1000.0 << " ms, "
+			  << GetJobWorkerCount() << " background workers " << parallelLoadTime * 1000.0 << " ms ("
+			  << serialLoadTime / parallelLoadTime << "x)" << std::endl;
+
+	// The reference path walks the glTF nodes, which an asset read from its cooked file lacks
+	if (bot.asset->model.nodes.empty()) {
+		std::swap(bot.asset->model, sourceAsset.model);
+	}
+
+	// Both paths must produce the same joint matrices
+	float maxDifference = 0.0f;
+	for (int i = 0; i < 100; ++i) {
+		bot.updateReference(i * timeStep);
+		std::vector<glm::mat4> reference = bot.jointMatrices;
+		bot.update(i * timeStep);
+		for (size_t j = 0; j < reference.size(); ++j) {
+			for (int c = 0; c < 4; ++c) {
+				glm::vec4 difference = glm::abs(reference[j][c] - bot.jointMatrices[j][c]);
+				maxDifference = std::max(maxDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			}
+		}
+	}
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < evaluations; ++i) {
+		bot.updateReference(i * timeStep);
+	}
+	std::chrono::duration<double> referenceTime = Clock::now() - start;
+
+	start = Clock::now();
+	for (int i = 0; i < evaluations; ++i) {
+		bot.update(i * timeStep);
+	}
+	std::chrono::duration<double> compiledTime = Clock::now() - start;
+
+	std::cout << std::setprecision(0)
+			  << "Animation benchmark (" << evaluations << " updates, " << bot.asset->model.nodes.size() << " nodes)" << std::endl
+			  << "  original: " << evaluations / referenceTime.count() << " updates/s" << std::endl
+			  << "  compiled: " << evaluations / compiledTime.count() << " updates/s" << std::endl
+			  << std::setprecision(6) << "  max joint matrix difference: " << maxDifference << std::endl;
+
+	// Baked clip: memory, bake time, and agreement with the compiled path at the frame times
+	float bakeRate = 30.0f;
+	int bakedFrames;
+	start = Clock::now();
+	std::vector<glm::mat4> baked = bot.asset->bakeAnimationFrames(bot.loopStartTime, bot.loopEndTime, bakeRate, bakedFrames);
+	std::chrono::duration<double> bakeTime = Clock::now() - start;
+	int jointCount = bot.asset->getJointCount();
+	float bakedDifference = 0.0f;
+	for (int frame = 0; frame < bakedFrames; ++frame) {
+		bot.update(bot.loopStartTime + frame / bakeRate);
+		for (int j = 0; j < jointCount; ++j) {
+			for (int c = 0; c < 4; ++c) {
+				glm::vec4 difference = glm::abs(baked[frame * jointCount + j][c] - bot.jointMatrices[j][c]);
+				bakedDifference = std::max(bakedDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			}
+		}
+	}
+	std::cout << std::setprecision(1) << "Baked clip: " << bakedFrames << " frames x " << jointCount << " joints = "
+			  << baked.size() * sizeof(glm::mat4) / 1024.0 << " KB, baked in " << bakeTime.count() * 1000.0 << " ms"
+			  << std::setprecision(6) << ", max difference " << bakedDifference << std::endl;
+
+	// Crowd update throughput as threads are added
+	const int crowdSize = 1024;
+	const int crowdUpdates = 50;
+	CrowdAnimator crowd;
+	start = Clock::now();
+	crowd.initialize(bot.asset->filename.c_str(), crowdSize, 120.0f);
+	std::chrono::duration<double> spawnTime = Clock::now() - start;
+	std::cout << std::setprecision(1) << "Spawned " << crowdSize << " instances: "
+			  << spawnTime.count() * 1e6 / crowdSize << " us and " << bot.instanceBytes() << " bytes each" << std::endl;
+	glm::mat4 viewMatrix = glm::lookAt(eye_center, lookat, up);
+	glm::mat4 projectionMatrix = glm::perspective(glm::radians(FoV), (float)windowWidth / windowHeight, zNear, zFar);
+	int maxThreads = GetDefaultJobWorkerCount() + 1;
+	double singleThreadRate = 0.0;
+	std::cout << "Crowd benchmark (" << crowdSize << " instances, " << crowdUpdates << " updates)" << std::endl;
+	useAnimationLOD = false;
+	for (int threads = 1; ; threads *= 2) {
+		threads = std::min(threads, maxThreads);
+		StartJobSystem(threads - 1);
+		crowd.update(timeStep, viewMatrix, projectionMatrix);
+
+		start = Clock::now();
+		for (int i = 0; i < crowdUpdates; ++i) {
+			crowd.update(timeStep, viewMatrix, projectionMatrix);
+		}
+		std::chrono::duration<double> crowdTime = Clock::now() - start;
+		double rate = crowdSize * crowdUpdates / crowdTime.count();
+		if (threads == 1) {
+			singleThreadRate = rate;
+		}
+		std::cout << std::setprecision(0) << "  " << threads << " threads: " << rate << " instance updates/s"
+				  << std::setprecision(2) << " (" << rate / singleThreadRate << "x)" << std::endl;
+		if (threads == maxThreads) {
+			break;
+		}
+	}
+
+	// Same crowd seen from the default camera, with levels of detail
+	useAnimationLOD = true;
+	crowd.update(timeStep, viewMatrix, projectionMatrix);
+	start = Clock::now();
+	for (int i = 0; i < crowdUpdates; ++i) {
+		crowd.update(timeStep, viewMatrix, projectionMatrix);
+	}
+	std::chrono::duration<double> lodTime = Clock::now() - start;
+	double lodRate = crowdSize * crowdUpdates / lodTime.count();
+	std::cout << std::setprecision(0) << "  " << maxThreads << " threads with LOD: " << lodRate << " instance updates/s"
+			  << std::setprecision(2) << " (" << lodRate / singleThreadRate << "x), tiers";
+	for (int level = 0; level < AnimationLODCount; ++level) {
+		std::cout << " " << crowd.lodCounts[level];
+	}
+	std::cout << ", joints per tier";
+	for (int level = 0; level < AnimationLODCount; ++level) {
+		std::cout << " " << bot.asset->lodSlotCounts[level];
+	}
+	std::cout << std::endl;
+
+	// A fresh instance first evaluated at the lowest tier must pose the slots it drops, the
+	// leaf joints, at the rest pose rather than at identity
+	int slotCount = (int)bot.asset->skeleton.nodes.size();
+	int lowestSlots = bot.asset->lodSlotCounts[AnimationLODCount - 1];
+	ModelAsset::AnimationState freshState;
+	bot.asset->initAnimationState(freshState);
+	bot.asset->evaluateAnimation(bot.asset->animationObjects[0], bot.loopStartTime, freshState, lowestSlots);
+	std::vector<glm::mat4> restTransforms(slotCount);
+	ComposeLocalTransforms(bot.asset->restPose, slotCount, restTransforms.data());
+	float leafDifference = 0.0f;
+	for (int slot = lowestSlots; slot < slotCount; ++slot) {
+		for (int c = 0; c < 4; ++c) {
+			glm::vec4 difference = glm::abs(freshState.localTransforms[slot][c] - restTransforms[slot][c]);
+			leafDifference = std::max(leafDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+		}
+	}
+	std::cout << std::setprecision(6) << "  fresh instance at the lowest tier: " << slotCount - lowestSlots
+			  << " dropped joints, max difference from rest pose " << leafDifference << std::endl;
+	StopJobSystem();
+	crowd.cleanup();
+}
+
+// Index of a command line option, or -1 if it is not given
+static int FindArgument(int argc, char **argv, const char *name)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int main(int argc, char **argv)
 {
 	// Initialise GLFW
 	if (!glfwInit())
@@ -720,9 +2226,62 @@ int main(void)
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 
-	// Our 3D character
-	MyBot bot;
-	bot.initialize();
+	uploadStaging = CreateStagingBuffer(UploadSliceSize);
+
+	// Our 3D character: --model <path> loads another .gltf or .glb file
+	const char *botModelPath = "../lab4/model/bot/bot.gltf";
+	int modelArgument = FindArgument(argc, argv, "--model");
+	if (modelArgument > 0 && modelArgument + 1 < argc) {
+		botModelPath = argv[modelArgument + 1];
+	}
+
+	// Load it on a background job and keep the window drawing until it is uploaded
+	StartJobSystem(GetDefaultJobWorkerCount());
+	optimizeMeshes = FindArgument(argc, argv, "--raw-meshes") < 0;
+	ModelAsset *botAsset = RequestModelAsset(botModelPath);
+	glfwSetWindowTitle(window, (std::string("Lab 4 | Loading ") + botModelPath).c_str());
+	while (botAsset->loading && !glfwWindowShouldClose(window)) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		RunMainThreadTasks(AssetUploadsPerFrame);
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+	}
+	ModelInstance bot;
+	bool botReady = !botAsset->loading && !botAsset->failed && bot.initialize(botModelPath);
+	ReleaseModelAsset(botAsset);
+	if (!botReady) {
+		StopJobSystem();
+		DestroyStagingBuffer(uploadStaging);
+		glfwTerminate();
+		return -1;
+	}
+
+	// --crowd N: animate N bots on a grid instead of one
+	CrowdAnimator crowd;
+	int crowdArgument = FindArgument(argc, argv, "--crowd");
+	if (crowdArgument > 0 && crowdArgument + 1 < argc) {
+		crowd.initialize(botModelPath, std::max(1, atoi(argv[crowdArgument + 1])), 120.0f);
+		std::cout << "Crowd of " << crowd.instances.size() << " bots on " << GetJobWorkerCount() + 1 << " threads" << std::endl;
+		size_t instancesPerDraw = crowd.getInstancesPerDraw();
+		if (instancesPerDraw < crowd.instances.size()) {
+			std::cout << "Joint palette holds " << instancesPerDraw << " bots, drawing the crowd in "
+					  << (crowd.instances.size() + instancesPerDraw - 1) / instancesPerDraw << " batches" << std::endl;
+		}
+	}
+
+	// --bench: time the animation update against the original and exit
+	if (FindArgument(argc, argv, "--bench") > 0) {
+		RunAnimationBenchmark(bot);
+		crowd.cleanup();
+		bot.cleanup();
+		DestroyStagingBuffer(uploadStaging);
+		glfwTerminate();
+		return 0;
+	}
+
+	// Joint matrices of the bots drawn by one batch, refilled every batch
+	size_t paletteInstances = std::max((size_t)1, crowd.instances.size());
+	JointPalette jointPalette = CreateJointPalette(paletteInstances * bot.asset->getJointCount());
 
 	// Camera setup
     glm::mat4 viewMatrix, projectionMatrix;
@@ -739,20 +2298,32 @@ int main(void)
 	{
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// Upload assets whose background load finished
+		RunMainThreadTasks(AssetUploadsPerFrame);
+
 		// Update states for animation
         double currentTime = glfwGetTime();
         float deltaTime = float(currentTime - lastTime);
 		lastTime = currentTime;
 
+		viewMatrix = glm::lookAt(eye_center, lookat, up);
+		useBakedCrowd = crowd.setBaked(useBakedCrowd);
 		if (playAnimation) {
 			time += deltaTime * playbackSpeed;
-			bot.update(time);
+			if (crowd.instances.empty()) {
+				bot.update(time);
+			} else {
+				crowd.update(deltaTime * playbackSpeed, viewMatrix, projectionMatrix);
+			}
 		}
 
 		// Rendering
-		viewMatrix = glm::lookAt(eye_center, lookat, up);
 		glm::mat4 vp = projectionMatrix * viewMatrix;
-		bot.render(vp);
+		if (crowd.instances.empty()) {
+			bot.render(vp, jointPalette);
+		} else {
+			crowd.render(vp, jointPalette);
+		}
 
 		// FPS tracking
 		// Count number of frames over a few seconds and take average
@@ -765,6 +2336,14 @@ int main(void)
 
 			std::stringstream stream;
 			stream << std::fixed << std::setprecision(2) << "Lab 4 | Frames per second (FPS): " << fps;
+			if (crowd.useBaked) {
+				stream << " | Baked animation";
+			} else if (!crowd.instances.empty()) {
+				stream << " | LOD " << (useAnimationLOD ? "on" : "off") << ":";
+				for (int level = 0; level < AnimationLODCount; ++level) {
+					stream << " " << crowd.lodCounts[level];
+				}
+			}
 			glfwSetWindowTitle(window, stream.str().c_str());
 		}
 
@@ -776,7 +2355,11 @@ int main(void)
 	while (!glfwWindowShouldClose(window));
 
 	// Clean up
+	StopJobSystem();
+	DestroyJointPalette(jointPalette);
+	crowd.cleanup();
 	bot.cleanup();
+	DestroyStagingBuffer(uploadStaging);
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -805,6 +2388,16 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 		playAnimation = !playAnimation;
 	}
 
+	// Toggle animation level of detail for crowds
+	if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+		useAnimationLOD = !useAnimationLOD;
+	}
+
+	// Toggle GPU playback of the baked clip for crowds
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		useBakedCrowd = !useBakedCrowd;
+	}
+
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 }
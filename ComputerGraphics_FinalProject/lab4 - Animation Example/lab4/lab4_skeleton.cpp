@@ -12,6 +12,7 @@
 #include <tiny_gltf.h>
 
 #include <render/shader.h>
+#include <asset/gltf_file.h>
 
 #include <vector>
 #include <iostream>
@@ -470,11 +471,10 @@ struct MyBot {
 
 
 	bool loadModel(tinygltf::Model &model, const char *filename) {
-		tinygltf::TinyGLTF loader;
 		std::string err;
 		std::string warn;
 
-		bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+		bool res = LoadGLTFFile(model, filename, err, warn);
 		if (!warn.empty()) {
 			std::cout << "WARN: " << warn << std::endl;
 		}
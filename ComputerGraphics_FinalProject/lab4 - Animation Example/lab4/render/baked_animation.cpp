@@ -0,0 +1,31 @@
+#include "baked_animation.h"
+
+BakedAnimation CreateBakedAnimation(const std::vector<glm::mat4> &frames, int frameCount, int jointCount,
+	float frameRate, float startTime)
+{
+	BakedAnimation baked;
+	baked.frameCount = frameCount;
+	baked.jointCount = jointCount;
+	baked.frameRate = frameRate;
+	baked.startTime = startTime;
+	baked.bytes = (size_t)frameCount * jointCount * sizeof(glm::mat4);
+
+	// glm matrices are column-major, so each frame row is already laid out as texels
+	glGenTextures(1, &baked.textureID);
+	glBindTexture(GL_TEXTURE_2D, baked.textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, jointCount * 4, frameCount, 0, GL_RGBA, GL_FLOAT, frames.data());
+
+	// Only read with texelFetch, but the texture must still be complete without mipmaps
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return baked;
+}
+
+void DestroyBakedAnimation(BakedAnimation &baked)
+{
+	glDeleteTextures(1, &baked.textureID);
+	baked.textureID = 0;
+	baked.bytes = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _BAKED_ANIMATION_H_
+#define _BAKED_ANIMATION_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Joint matrices of one looping clip sampled at a fixed rate, in a 2D RGBA32F texture.
+// Row f holds frame f and each joint takes four texels (its columns), so the shader
+// reads joint j of frame f at texels (j * 4 .. j * 4 + 3, f).
+struct BakedAnimation {
+	GLuint textureID;
+	int frameCount;
+	int jointCount;
+	float frameRate;		// Frames per second of clip time
+	float startTime;		// Clip time of frame 0
+	size_t bytes;			// Texture memory
+};
+
+// frames holds frameCount * jointCount matrices, frame by frame
+BakedAnimation CreateBakedAnimation(const std::vector<glm::mat4> &frames, int frameCount, int jointCount,
+	float frameRate, float startTime);
+
+void DestroyBakedAnimation(BakedAnimation &baked);
+
+#endif
@@ -0,0 +1,77 @@
+#include "joint_palette.h"
+
+#include <algorithm>
+
+size_t GetJointPaletteLimit()
+{
+	// At least 65536 texels in GL 3.3, four per matrix
+	static GLint maxTexels = 0;
+	if (maxTexels == 0) {
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	}
+	return (size_t)maxTexels / 4;
+}
+
+JointPalette CreateJointPalette(size_t capacity)
+{
+	JointPalette palette;
+	palette.capacity = std::min(capacity, GetJointPaletteLimit());
+
+	glGenBuffers(1, &palette.bufferID);
+	glBindBuffer(GL_TEXTURE_BUFFER, palette.bufferID);
+	glBufferData(GL_TEXTURE_BUFFER, palette.capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+
+	// The texture refers to the buffer object, so it stays valid when the storage is reallocated
+	glGenTextures(1, &palette.textureID);
+	glBindTexture(GL_TEXTURE_BUFFER, palette.textureID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, palette.bufferID);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	return palette;
+}
+
+glm::mat4 *MapJointPalette(JointPalette &palette, size_t count)
+{
+	size_t limit = GetJointPaletteLimit();
+	if (count > limit) {
+		return NULL;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, palette.bufferID);
+
+	// Grow by doubling so a slowly growing crowd does not reallocate every frame
+	if (count > palette.capacity) {
+		while (palette.capacity < count) {
+			palette.capacity = palette.capacity > 0 ? palette.capacity * 2 : count;
+		}
+		palette.capacity = std::min(palette.capacity, limit);
+		glBufferData(GL_TEXTURE_BUFFER, palette.capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+	}
+	if (count == 0) {
+		return NULL;
+	}
+
+	return (glm::mat4*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, count * sizeof(glm::mat4),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void UnmapJointPalette(JointPalette &palette)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, palette.bufferID);
+	glUnmapBuffer(GL_TEXTURE_BUFFER);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void BindJointPalette(const JointPalette &palette, GLuint unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_BUFFER, palette.textureID);
+}
+
+void DestroyJointPalette(JointPalette &palette)
+{
+	glDeleteTextures(1, &palette.textureID);
+	glDeleteBuffers(1, &palette.bufferID);
+	palette.textureID = palette.bufferID = 0;
+	palette.capacity = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _JOINT_PALETTE_H_
+#define _JOINT_PALETTE_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Joint matrices of every skinned instance drawn in a frame, in one texture buffer.
+// Each matrix takes four RGBA32F texels (its columns), so the shader fetches joint j of
+// instance i at texel (offset + i * jointCount + j) * 4 and there is no fixed joint cap.
+// The shader can only reach GL_MAX_TEXTURE_BUFFER_SIZE texels, so larger sets of instances
+// are drawn in batches of at most GetJointPaletteLimit() matrices.
+struct JointPalette {
+	GLuint bufferID;
+	GLuint textureID;
+	size_t capacity;		// Matrices the buffer can hold
+};
+
+// Most matrices one palette can hold, from GL_MAX_TEXTURE_BUFFER_SIZE
+size_t GetJointPaletteLimit();
+
+// capacity is clamped to GetJointPaletteLimit()
+JointPalette CreateJointPalette(size_t capacity);
+
+// Map the palette for writing count matrices from the start. The previous contents are
+// orphaned, so the driver never waits for draws still reading an earlier batch or frame.
+// Returns NULL if count is 0 or above GetJointPaletteLimit().
+glm::mat4 *MapJointPalette(JointPalette &palette, size_t count);
+
+void UnmapJointPalette(JointPalette &palette);
+
+// Bind the palette texture to a texture unit (0 for GL_TEXTURE0)
+void BindJointPalette(const JointPalette &palette, GLuint unit);
+
+void DestroyJointPalette(JointPalette &palette);
+
+#endif
@@ -0,0 +1,69 @@
+#include "staging_buffer.h"
+
+#include <cstdio>
+#include <cstring>
+
+StagingBuffer CreateStagingBuffer(size_t sliceSize)
+{
+	StagingBuffer staging;
+	staging.sliceSize = sliceSize;
+
+	glGenBuffers(1, &staging.bufferID);
+	glBindBuffer(GL_COPY_READ_BUFFER, staging.bufferID);
+	glBufferData(GL_COPY_READ_BUFFER, sliceSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return staging;
+}
+
+GLuint UploadStaticBuffer(StagingBuffer &staging, const void *data, size_t size)
+{
+	GLuint bufferID;
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	if (size <= staging.sliceSize) {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return bufferID;
+	}
+
+	glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, staging.bufferID);
+	const unsigned char *bytes = (const unsigned char *)data;
+	bool mapped = true;
+	for (size_t offset = 0; offset < size; offset += staging.sliceSize) {
+		size_t sliceBytes = size - offset < staging.sliceSize ? size - offset : staging.sliceSize;
+
+		// Invalidating lets the driver hand out fresh storage while the previous slice's
+		// copy is still pending, instead of waiting for it
+		void *slice = mapped ? glMapBufferRange(GL_COPY_READ_BUFFER, 0, sliceBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) : NULL;
+		if (slice == NULL) {
+			// Still fill the whole buffer, one slice at a time through the driver
+			if (mapped) {
+				printf("Mapping the staging buffer failed, uploading the rest with glBufferSubData\n");
+				mapped = false;
+			}
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, sliceBytes, bytes + offset);
+			continue;
+		}
+		memcpy(slice, bytes + offset, sliceBytes);
+
+		// The mapping was lost, for example on a mode switch: the slice must be sent again
+		if (glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_FALSE) {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, sliceBytes, bytes + offset);
+			continue;
+		}
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, sliceBytes);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return bufferID;
+}
+
+void DestroyStagingBuffer(StagingBuffer &staging)
+{
+	glDeleteBuffers(1, &staging.bufferID);
+	staging.bufferID = 0;
+	staging.sliceSize = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef _STAGING_BUFFER_H_
+#define _STAGING_BUFFER_H_
+
+#include <glad/gl.h>
+#include <cstddef>
+
+// Fixed-size buffer reused for every large upload. Data goes through it one slice at a
+// time and is copied on the GPU into its destination, so the driver never takes a whole
+// multi-megabyte array in one call and the source is read a slice at a time.
+struct StagingBuffer {
+	GLuint bufferID;
+	size_t sliceSize;		// Bytes per slice
+};
+
+StagingBuffer CreateStagingBuffer(size_t sliceSize);
+
+// Create a GL_STATIC_DRAW buffer holding size bytes of data. Arrays up to one slice go
+// straight to glBufferData; larger ones are copied through the staging buffer, or passed
+// to glBufferSubData slice by slice if it cannot be mapped, so the buffer is always filled.
+GLuint UploadStaticBuffer(StagingBuffer &staging, const void *data, size_t size);
+
+void DestroyStagingBuffer(StagingBuffer &staging);
+
+#endif
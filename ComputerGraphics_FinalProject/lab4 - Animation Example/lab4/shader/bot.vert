@@ -8,12 +8,23 @@ layout(location = 4) in vec4 inWeights;    // Joint weights
 
 // Uniforms
 uniform mat4 MVP;                  // Model-View-Projection matrix
-uniform mat4 jointMatrices[50];    // Array of joint matrices
+uniform samplerBuffer jointPalette; // Joint matrices of every instance, 4 texels per matrix
+uniform int jointCount;            // Joint matrices per instance
+uniform int paletteOffset;         // First matrix of instance 0 in this draw
 
 // Outputs to the fragment shader
 out vec3 worldPosition;
 out vec3 worldNormal;
 
+// Joint matrix of this instance, read column by column from the palette
+mat4 getJointMatrix(uint jointIndex) {
+    int texel = (paletteOffset + gl_InstanceID * jointCount + int(jointIndex)) * 4;
+    return mat4(texelFetch(jointPalette, texel),
+                texelFetch(jointPalette, texel + 1),
+                texelFetch(jointPalette, texel + 2),
+                texelFetch(jointPalette, texel + 3));
+}
+
 void main() {
     // Skinning transformation
     vec4 skinnedPosition = vec4(0.0); // Initialize skinned position
@@ -27,7 +38,7 @@ void main() {
             uint jointIndex = inJoints[i];
 
             // Retrieve the joint matrix
-            mat4 jointMatrix = jointMatrices[jointIndex];
+            mat4 jointMatrix = getJointMatrix(jointIndex);
 
             // Apply skinning to the position
             skinnedPosition += weight * (jointMatrix * vec4(inPosition, 1.0));
@@ -0,0 +1,78 @@
+#version 330 core
+
+// Attributes
+layout(location = 0) in vec3 inPosition;   // Vertex position
+layout(location = 1) in vec3 inNormal;     // Vertex normal
+layout(location = 3) in uvec4 inJoints;    // Joint indices (as unsigned integers)
+layout(location = 4) in vec4 inWeights;    // Joint weights
+
+// Uniforms
+uniform mat4 MVP;                  // Model-View-Projection matrix
+uniform sampler2D bakedPose;       // Row f: joint matrices of frame f, 4 texels per matrix
+uniform samplerBuffer instanceRecords; // Per instance: world transform with (start time, speed) in its bottom row
+uniform float time;                // Seconds since the instance records were written
+uniform float loopStartTime;       // Clip time of frame 0
+uniform float frameRate;           // Baked frames per second of clip time
+uniform int frameCount;
+
+// Outputs to the fragment shader
+out vec3 worldPosition;
+out vec3 worldNormal;
+
+mat4 getBakedJointMatrix(int frame, uint jointIndex) {
+    int texel = int(jointIndex) * 4;
+    return mat4(texelFetch(bakedPose, ivec2(texel, frame), 0),
+                texelFetch(bakedPose, ivec2(texel + 1, frame), 0),
+                texelFetch(bakedPose, ivec2(texel + 2, frame), 0),
+                texelFetch(bakedPose, ivec2(texel + 3, frame), 0));
+}
+
+void main() {
+    // Instance record: an affine world transform whose free bottom row carries the playback state
+    int record = gl_InstanceID * 4;
+    vec4 column0 = texelFetch(instanceRecords, record);
+    vec4 column1 = texelFetch(instanceRecords, record + 1);
+    vec4 column2 = texelFetch(instanceRecords, record + 2);
+    vec4 column3 = texelFetch(instanceRecords, record + 3);
+    mat4 worldTransform = mat4(vec4(column0.xyz, 0.0), vec4(column1.xyz, 0.0), vec4(column2.xyz, 0.0), vec4(column3.xyz, 1.0));
+
+    // Same looping as the CPU path: hold the first frame before the loop, then wrap
+    float playbackTime = column0.w + time * column1.w;
+    float loopTime = max(playbackTime - loopStartTime, 0.0);
+    float frame = mod(loopTime * frameRate, float(frameCount));
+    int frame0 = int(frame);
+    int frame1 = frame0 + 1 < frameCount ? frame0 + 1 : 0;
+    float blend = fract(frame);
+
+    // Skinning transformation
+    vec4 skinnedPosition = vec4(0.0); // Initialize skinned position
+    vec3 skinnedNormal = vec3(0.0);   // Initialize skinned normal
+
+    // Loop over the four possible joint influences
+    for (int i = 0; i < 4; i++) {
+        float weight = inWeights[i];
+        if (weight > 0.0) {
+            // Get the joint index from the vertex attribute
+            uint jointIndex = inJoints[i];
+
+            // Blend the joint matrix between the two nearest baked frames
+            mat4 jointMatrix = getBakedJointMatrix(frame0, jointIndex) * (1.0 - blend) +
+                               getBakedJointMatrix(frame1, jointIndex) * blend;
+            jointMatrix = worldTransform * jointMatrix;
+
+            // Apply skinning to the position
+            skinnedPosition += weight * (jointMatrix * vec4(inPosition, 1.0));
+
+            // Apply skinning to the normal
+            mat3 jointMatrix3 = mat3(jointMatrix);
+            skinnedNormal += weight * (jointMatrix3 * inNormal);
+        }
+    }
+
+    // Pass world-space data to the fragment shader
+    worldPosition = vec3(skinnedPosition);
+    worldNormal = normalize(skinnedNormal);
+
+    // Transform to clip space
+    gl_Position = MVP * skinnedPosition;
+}